@@ -4,9 +4,542 @@
 #include <atomic>
 #include <chrono>
 #include <mutex>
+#include <shared_mutex>
 #include <array>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <system_error>
+#include <stdexcept>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <condition_variable>
 
-template <typename T>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
+#include <sstream>
+#endif
+
+constexpr size_t cache_line_size = 64;
+
+// machine specific defaults of the ring, AtomicSharedPtrConfig.h is written by running with --tune
+#if __has_include("AtomicSharedPtrConfig.h")
+#include "AtomicSharedPtrConfig.h"
+#else
+constexpr size_t tuned_ring_size = 4;
+constexpr bool tuned_padded_ring_usage = false;
+constexpr unsigned tuned_ring_retry_backoff = 0;
+#endif
+
+// spin loop hint, lets sibling hyperthread run while we are waiting
+inline void cpu_relax() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// hint to fetch the cache line of p, doesn't fault on any address
+inline void prefetch(const void* p) {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    static_cast<void>(p);
+#endif
+}
+
+// spins on predicate, falls back to yield when owner of the awaited state is likely descheduled.
+// on a single cpu the owner can't make progress while we spin, so yield right away
+template <typename Predicate>
+void spin_until(Predicate ready) {
+    static const unsigned spin_limit = std::thread::hardware_concurrency() > 1 ? 64 : 0;
+    for (unsigned spins = 0; !ready(); ++spins) {
+        if (spins < spin_limit) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// stress testing hooks, compiled in with -DATOMIC_SHARED_PTR_INJECT_FAULTS. an injection point
+// sometimes delays or yields the thread to widen the window around it, an injected failure makes
+// a weak CAS fail spuriously or a claim attempt give up. every thread draws from its own rng seeded
+// with seed and the order in which threads first hit a point, so a run is repeatable up to scheduling
+#ifdef ATOMIC_SHARED_PTR_INJECT_FAULTS
+struct fault_injection {
+    inline static std::atomic<uint64_t> seed = { 1 };
+    // out of 1024 draws
+    inline static unsigned delay_rate = 32;
+    inline static unsigned yield_rate = 8;
+    inline static unsigned failure_rate = 64;
+
+    static void point() {
+        auto draw = next();
+        if (draw % 1024 < yield_rate) {
+            std::this_thread::yield();
+        } else if (draw % 1024 < yield_rate + delay_rate) {
+            for (auto pauses = (draw >> 10) % 256; pauses > 0; --pauses) {
+                cpu_relax();
+            }
+        }
+    }
+
+    static bool failure() {
+        return next() % 1024 < failure_rate;
+    }
+
+private:
+    inline static std::atomic<uint64_t> threads = { 0 };
+
+    static uint64_t next() {
+        // splitmix64 of seed and thread order, then xorshift
+        static thread_local uint64_t state = [] {
+            auto mixed = seed.load() + 0x9E3779B97F4A7C15ull * (threads.fetch_add(1) + 1);
+            mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+            mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+            return (mixed ^ (mixed >> 31)) | 1;
+        }();
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+#define INJECTION_POINT() fault_injection::point()
+#define INJECTED_FAILURE() fault_injection::failure()
+#else
+#define INJECTION_POINT() static_cast<void>(0)
+#define INJECTED_FAILURE() false
+#endif
+
+// kernel id of the calling thread, 0 where there is no cheap way to watch other threads
+inline int current_thread_kernel_id() {
+#ifdef __linux__
+    static thread_local const int id = static_cast<int>(syscall(SYS_gettid));
+    return id;
+#else
+    return 0;
+#endif
+}
+
+// cpu time consumed by a thread of this process, -1 when unknown, e.g. after the thread exited
+inline long long thread_cpu_time(int kernel_id) {
+#ifdef __linux__
+    if (kernel_id == 0) {
+        return -1;
+    }
+    // per-thread scheduler clock, the same id pthread_getcpuclockid() builds
+    const clockid_t clock = (~static_cast<clockid_t>(kernel_id) << 3) | 2 | 4;
+    timespec time;
+    if (clock_gettime(clock, &time) != 0) {
+        return -1;
+    }
+    return time.tv_sec * 1000000000ll + time.tv_nsec;
+#else
+    static_cast<void>(kernel_id);
+    return -1;
+#endif
+}
+
+// waits for a thread holding something we need: spins while the holder runs and yields once it
+// stops consuming cpu time, which means it was descheduled and spinning only takes its cpu away.
+// the holder is checked every spin_limit pauses, holders we can't watch are yielded to.
+// there is no priority boosting in user space, yielding is what lets a preempted holder back on
+class holder_aware_backoff {
+public:
+    void pause(int holder) {
+        static const unsigned spin_limit = std::thread::hardware_concurrency() > 1 ? 64 : 0;
+        if (spin_limit == 0) {
+            // on a single cpu the holder can't run while we spin
+            std::this_thread::yield();
+            return;
+        }
+        if (++spins < spin_limit) {
+            cpu_relax();
+            return;
+        }
+        spins = 0;
+        auto cpu_time = thread_cpu_time(holder);
+        // a new holder gets the benefit of the doubt, a known one must have run since the last look
+        bool running = cpu_time >= 0 && (holder != last_holder || cpu_time != last_cpu_time);
+        last_holder = holder;
+        last_cpu_time = cpu_time;
+        if (running) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    unsigned spins = 0;
+    int last_holder = 0;
+    long long last_cpu_time = -1;
+};
+
+// fifo queue lock: every waiter spins on its own cache line and is handed the lock by its predecessor.
+// queue nodes are taken from a per-thread free list, so the lock satisfies BasicLockable
+// and a thread may hold several of them at once
+class mcs_lock {
+public:
+    void lock() {
+        auto node = acquire_node();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->locked.store(true, std::memory_order_relaxed);
+        auto predecessor = tail.exchange(node, std::memory_order_acq_rel);
+        INJECTION_POINT();
+        if (predecessor) {
+            predecessor->next.store(node, std::memory_order_release);
+            spin_until([node] { return !node->locked.load(std::memory_order_acquire); });
+        }
+        owner = node;
+    }
+
+    void unlock() {
+        auto node = owner;
+        auto successor = node->next.load(std::memory_order_acquire);
+        INJECTION_POINT();
+        if (!successor) {
+            auto expected = node;
+            if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed)) {
+                release_node(node);
+                return;
+            }
+            // successor is between tail exchange and linking itself
+            spin_until([&] { return (successor = node->next.load(std::memory_order_acquire)) != nullptr; });
+        }
+        successor->locked.store(false, std::memory_order_release);
+        release_node(node);
+    }
+
+private:
+    struct alignas(cache_line_size) node {
+        std::atomic<node*> next = { nullptr };
+        std::atomic_bool locked = { false };
+        node* free_next = nullptr;
+    };
+
+    struct node_pool {
+        node* free = nullptr;
+        std::vector<std::unique_ptr<node>> nodes;
+    };
+
+    static node_pool& local_pool() {
+        static thread_local node_pool pool;
+        return pool;
+    }
+
+    static node* acquire_node() {
+        auto& pool = local_pool();
+        if (!pool.free) {
+            pool.nodes.push_back(std::make_unique<node>());
+            return pool.nodes.back().get();
+        }
+        auto result = pool.free;
+        pool.free = result->free_next;
+        return result;
+    }
+
+    static void release_node(node* n) {
+        auto& pool = local_pool();
+        n->free_next = pool.free;
+        pool.free = n;
+    }
+
+    alignas(cache_line_size) std::atomic<node*> tail = { nullptr };
+    // accessed only by the lock holder
+    node* owner = nullptr;
+};
+
+// numa topology, everything is a single node when platform doesn't tell otherwise
+#if defined(__linux__)
+struct numa_topology {
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<size_t> cpu_nodes;
+
+    numa_topology() {
+        for (size_t node = 0; node < 256; ++node) {
+            std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!cpulist) {
+                continue;
+            }
+            node_cpus.resize(node + 1);
+            // cpulist looks like "0-3,8-11"
+            std::string range;
+            while (std::getline(cpulist, range, ',')) {
+                int first = 0;
+                int last = 0;
+                char dash = 0;
+                std::istringstream parser(range);
+                if (!(parser >> first)) {
+                    continue;
+                }
+                last = parser >> dash >> last ? last : first;
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    node_cpus[node].push_back(cpu);
+                    if (cpu_nodes.size() <= static_cast<size_t>(cpu)) {
+                        cpu_nodes.resize(cpu + 1);
+                    }
+                    cpu_nodes[cpu] = node;
+                }
+            }
+        }
+        if (node_cpus.empty()) {
+            node_cpus.resize(1);
+        }
+    }
+
+    static const numa_topology& get() {
+        static const numa_topology topology;
+        return topology;
+    }
+};
+#endif
+
+inline size_t numa_node_count() {
+#if defined(_WIN32)
+    ULONG highest = 0;
+    return GetNumaHighestNodeNumber(&highest) ? highest + 1 : 1;
+#elif defined(__linux__)
+    return numa_topology::get().node_cpus.size();
+#else
+    return 1;
+#endif
+}
+
+inline size_t current_numa_node() {
+#if defined(_WIN32)
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node = 0;
+    return GetNumaProcessorNodeEx(&processor, &node) ? node : 0;
+#elif defined(__linux__)
+    auto cpu = sched_getcpu();
+    auto& cpu_nodes = numa_topology::get().cpu_nodes;
+    return cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes.size() ? cpu_nodes[cpu] : 0;
+#else
+    return 0;
+#endif
+}
+
+// restricts current thread to cpus of the node, returns false if it isn't possible
+inline bool pin_current_thread_to_numa_node(size_t node) {
+#if defined(_WIN32)
+    GROUP_AFFINITY affinity = {};
+    return GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) &&
+        SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+#elif defined(__linux__)
+    auto& node_cpus = numa_topology::get().node_cpus;
+    if (node >= node_cpus.size() || node_cpus[node].empty()) {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (auto cpu : node_cpus[node]) {
+        CPU_SET(cpu, &cpus);
+    }
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+// fifo spin lock which may be released by a thread other than the owner
+class ticket_lock {
+public:
+    void lock() {
+        auto ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+        spin_until([this, ticket] { return now_serving.load(std::memory_order_acquire) == ticket; });
+    }
+
+    void unlock() {
+        now_serving.store(now_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // must be called by the lock holder
+    bool has_waiters() const {
+        return next_ticket.load(std::memory_order_relaxed) - now_serving.load(std::memory_order_relaxed) > 1;
+    }
+
+private:
+    std::atomic<unsigned> next_ticket = { 0 };
+    std::atomic<unsigned> now_serving = { 0 };
+};
+
+// numa-aware cohort lock: a thread takes its node's local lock first and the global lock only
+// if its cohort doesn't hold it already. on release the global lock is passed to a waiter
+// from the same node, up to max_local_handoffs times in a row to keep other nodes from starving
+class cohort_lock {
+public:
+    cohort_lock(size_t node_count = numa_node_count()) :
+        node_count(node_count), nodes(std::make_unique<node_lock[]>(node_count)) {}
+
+    void lock() {
+        auto node = current_numa_node() % node_count;
+        auto& local = nodes[node];
+        local.lock.lock();
+        INJECTION_POINT();
+        if (!local.owns_global) {
+            global.lock();
+            local.owns_global = true;
+        }
+        owner_node = node;
+    }
+
+    void unlock() {
+        auto& local = nodes[owner_node];
+        if (local.lock.has_waiters() && local.handoffs < max_local_handoffs) {
+            // keep global lock within the cohort
+            ++local.handoffs;
+        } else {
+            local.handoffs = 0;
+            local.owns_global = false;
+            global.unlock();
+        }
+        INJECTION_POINT();
+        local.lock.unlock();
+    }
+
+private:
+    static constexpr unsigned max_local_handoffs = 64;
+
+    struct alignas(cache_line_size) node_lock {
+        ticket_lock lock;
+        // guarded by lock
+        bool owns_global = false;
+        unsigned handoffs = 0;
+    };
+
+    const size_t node_count;
+    std::unique_ptr<node_lock[]> nodes;
+    alignas(cache_line_size) ticket_lock global;
+    // accessed only by the lock holder
+    size_t owner_node = 0;
+};
+
+// blocks while word equals expected, may return spuriously
+inline void futex_wait(std::atomic<int>& word, int expected) {
+#if defined(_WIN32)
+    WaitOnAddress(&word, &expected, sizeof(expected), INFINITE);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    (void)word;
+    (void)expected;
+    std::this_thread::yield();
+#endif
+}
+
+inline void futex_wake_one(std::atomic<int>& word) {
+#if defined(_WIN32)
+    WakeByAddressSingle(&word);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+// lock for tiny critical sections: spins with pause for about two recent hold times,
+// then parks on a futex. every hold_sample_period-th holder measures its hold time,
+// so the spin window follows the actual critical section length
+class hybrid_futex_lock {
+public:
+    void lock() {
+        int state = unlocked;
+        if (INJECTED_FAILURE() ||
+            !word.compare_exchange_strong(state, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+            lock_contended();
+        }
+        acquired_at = ++acquisitions % hold_sample_period == 0 ? now() : 0;
+    }
+
+    void unlock() {
+        if (acquired_at != 0) {
+            auto held = now() - acquired_at;
+            auto estimate = hold_estimate.load(std::memory_order_relaxed);
+            hold_estimate.store(estimate + (held - estimate) / 8, std::memory_order_relaxed);
+        }
+
+        if (word.exchange(unlocked, std::memory_order_release) == contended) {
+            INJECTION_POINT();
+            futex_wake_one(word);
+        }
+    }
+
+private:
+    static constexpr int unlocked = 0;
+    static constexpr int locked = 1;
+    static constexpr int contended = 2;
+    static constexpr long long max_spin_ns = 20000;
+    static constexpr unsigned hold_sample_period = 16;
+
+    static long long now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void lock_contended() {
+        static const bool may_spin = std::thread::hardware_concurrency() > 1;
+        if (may_spin) {
+            auto spin_ns = std::min(2 * hold_estimate.load(std::memory_order_relaxed), max_spin_ns);
+            auto spin_start = now();
+            do {
+                for (int i = 0; i < 16; ++i) {
+                    cpu_relax();
+                }
+                int state = word.load(std::memory_order_relaxed);
+                if (state == unlocked && !INJECTED_FAILURE() &&
+                    word.compare_exchange_weak(state, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return;
+                }
+            } while (now() - spin_start < spin_ns);
+        }
+
+        // we may be parked, so whoever unlocks has to wake somebody
+        while (word.exchange(contended, std::memory_order_acquire) != unlocked) {
+            INJECTION_POINT();
+            futex_wait(word, contended);
+        }
+    }
+
+    std::atomic<int> word = { unlocked };
+    std::atomic<long long> hold_estimate = { 0 };
+    // accessed only by the lock holder
+    long long acquired_at = 0;
+    unsigned acquisitions = 0;
+};
+
+template <typename T, typename Mutex = std::mutex>
 class naive_atomic_shared_ptr_with_mutex {
 public:
     naive_atomic_shared_ptr_with_mutex(const std::shared_ptr<T>& p) :pointer(p) {}
@@ -25,10 +558,125 @@ public:
     }
 
 private:
-    mutable std::mutex mutex;
+    mutable Mutex mutex;
     std::shared_ptr<T> pointer;
 };
 
+template <typename T>
+using atomic_shared_ptr_with_mcs_lock = naive_atomic_shared_ptr_with_mutex<T, mcs_lock>;
+
+template <typename T>
+using atomic_shared_ptr_with_cohort_lock = naive_atomic_shared_ptr_with_mutex<T, cohort_lock>;
+
+template <typename T>
+using atomic_shared_ptr_with_hybrid_lock = naive_atomic_shared_ptr_with_mutex<T, hybrid_futex_lock>;
+
+// reader-writer lock with a third, optimistic read mode: the reader takes a stamp,
+// reads without any store and then validates that no writer came in between
+class stamped_lock {
+public:
+    // returns 0 when write lock is held
+    uint64_t try_optimistic_read() const {
+        auto current = stamp.load(std::memory_order_acquire);
+        return current & write_bit ? 0 : current;
+    }
+
+    // true if no writer entered since observed stamp was taken, fences reads made before
+    bool validate(uint64_t observed) const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return stamp.load(std::memory_order_relaxed) == observed;
+    }
+
+    void lock() {
+        spin_until([this] {
+            auto current = stamp.load(std::memory_order_relaxed);
+            return !(current & write_bit) && !INJECTED_FAILURE() && stamp.compare_exchange_weak(current, current + 1);
+        });
+        // seq_cst, pairs with the increment and stamp load in lock_shared()
+        spin_until([this] { return readers.load() == 0; });
+    }
+
+    void unlock() {
+        stamp.fetch_add(1, std::memory_order_release);
+    }
+
+    void lock_shared() {
+        for (;;) {
+            // pairs with stamp update in lock(), one of us must see the other
+            readers.fetch_add(1);
+            if (!(stamp.load() & write_bit)) {
+                return;
+            }
+            readers.fetch_sub(1, std::memory_order_relaxed);
+            spin_until([this] { return !(stamp.load(std::memory_order_relaxed) & write_bit); });
+        }
+    }
+
+    void unlock_shared() {
+        readers.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static constexpr uint64_t write_bit = 1;
+
+    // odd while write lock is held, starts from 2 so 0 is never a valid stamp
+    std::atomic<uint64_t> stamp = { 2 };
+    alignas(cache_line_size) std::atomic<int> readers = { 0 };
+};
+
+// mutex-like wrapper, but readers copy the value optimistically and take the read lock only on conflict.
+// values live in type-stable slots owned through shared_ptr: a reader pins the slot by copying
+// its (never changing) shared_ptr, validates the stamp and only then copies the value.
+// writer never refills a pinned slot, so the copy is safe once the stamp is validated
+template <typename T, size_t slot_count = 4>
+class atomic_shared_ptr_with_stamped_lock {
+public:
+    // initialization is not atomic and thread safe
+    atomic_shared_ptr_with_stamped_lock(const std::shared_ptr<T>& p) {
+        for (auto& slot : slots) {
+            slot = std::make_shared<std::shared_ptr<T>>();
+        }
+        *slots[0] = p;
+    }
+
+    atomic_shared_ptr_with_stamped_lock& operator=(const std::shared_ptr<T>& p) {
+        std::lock_guard guard(lock);
+        // pairs with validate() in readers: either we see their pin or they see our stamp
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto active = current.load(std::memory_order_relaxed);
+        auto idx = (active + 1) % slot_count;
+        // pins are held only for a single copy and readers back off on our stamp
+        while (idx == active || slots[idx].use_count() != 1) {
+            idx = (idx + 1) % slot_count;
+            cpu_relax();
+        }
+        // order with the last reader's release of its pin
+        std::atomic_thread_fence(std::memory_order_acquire);
+        *slots[idx] = p;
+        INJECTION_POINT();
+        current.store(idx, std::memory_order_relaxed);
+        return *this;
+    }
+
+    operator std::shared_ptr<T>() const {
+        if (auto stamp = lock.try_optimistic_read()) {
+            std::shared_ptr<std::shared_ptr<T>> pinned = slots[current.load(std::memory_order_relaxed)];
+            INJECTION_POINT();
+            if (lock.validate(stamp)) {
+                return *pinned;
+            }
+        }
+        std::shared_lock guard(lock);
+        return *slots[current.load(std::memory_order_relaxed)];
+    }
+
+private:
+    // never reassigned after construction, so readers may copy them without synchronization
+    std::array<std::shared_ptr<std::shared_ptr<T>>, slot_count> slots;
+    std::atomic<size_t> current = { 0 };
+    mutable stamped_lock lock;
+};
+
 template <typename T>
 class atomic_shared_ptr_using_std_atomic {
 public:
@@ -50,7 +698,10 @@ private:
 
 constexpr int under_construction_label = std::numeric_limits<int>::max() / 2;
 
-template <typename T, size_t ring_size = 4>
+// padded_usage puts every usage counter on its own cache line, retry_backoff is the number of
+// pause instructions after a failed attempt
+template <typename T, size_t ring_size = tuned_ring_size, bool single_writer = false,
+    bool padded_usage = tuned_padded_ring_usage, unsigned retry_backoff = tuned_ring_retry_backoff>
 class atomic_shared_ptr_with_ring {
 public:
     // initialization is not atomic and thread safe
@@ -59,17 +710,26 @@ public:
     }
 
     atomic_shared_ptr_with_ring& operator=(const std::shared_ptr<T>& p) {
+        if constexpr (single_writer) {
+            return assign_from_single_writer(p);
+        }
 
         for (;;)
         {
             // choose pointer for writing
             auto idx = current_write_pointer.fetch_add(1) % ring_size;
+            if constexpr (scan_for_free_slots) {
+                idx = find_free_slot(idx);
+            }
 
             // record usage by our thread
             pointer_usage[idx].fetch_add(1);
+            INJECTION_POINT();
 
             if (idx == current_read_pointer) {
                 pointer_usage[idx].fetch_sub(1);
+                retries.fetch_add(1, std::memory_order_relaxed);
+                back_off();
                 // don't start construction on the active road
                 continue;
             }
@@ -77,119 +737,2996 @@ public:
             // we are in hope that idx pointer is used exclusivly by our thread
             // and put under_construction_label to protect it from usage by other threads
             int expected = 1;
-            if (!pointer_usage[idx].compare_exchange_weak(expected, under_construction_label + 1)) {
+            if ((INJECTED_FAILURE() || !pointer_usage[idx].compare_exchange_weak(expected, under_construction_label + 1)) &&
+                // recycled pointer is left under construction, so we already own it
+                expected != under_construction_label + 1) {
                 pointer_usage[idx].fetch_sub(1);
+                retries.fetch_add(1, std::memory_order_relaxed);
+                back_off();
                 // pointer already in use by other thread, try with different pointer
                 continue;
             }
             // at this point we obtained exclusive ownership on idx pointer and alowed to modify it
+            claimed_by[idx].store(current_thread_kernel_id(), std::memory_order_relaxed);
+            INJECTION_POINT();
             pointers[idx] = p;
+            INJECTION_POINT();
             // degradate usage lock to read-only (must be ordered with previous pointer modification)
             pointer_usage[idx].fetch_sub(under_construction_label);
+            INJECTION_POINT();
             // make it readable
             current_read_pointer = idx;
+            INJECTION_POINT();
             // release usage by our thread
             pointer_usage[idx].fetch_sub(1);
+            if (eager_release) {
+                release_retired();
+            }
             return *this;
         }
     }
 
     operator std::shared_ptr<T>() const {
         std::shared_ptr<T> result;
+        holder_aware_backoff backoff;
         for (;;) {
             auto idx = current_read_pointer.load();
+            INJECTION_POINT();
             auto usage = pointer_usage[idx].fetch_add(1);
 
             if (usage >= under_construction_label) {
                 pointer_usage[idx].fetch_sub(1);
+                retries.fetch_add(1, std::memory_order_relaxed);
+                back_off();
+                backoff.pause(claimed_by[idx].load(std::memory_order_relaxed));
                 continue;
             }
 
+            INJECTION_POINT();
             result = pointers[idx];
+            INJECTION_POINT();
             pointer_usage[idx].fetch_sub(1);
             return result;
         }
     }
 
-private:
-    std::array<std::shared_ptr<T>, ring_size> pointers;
-    mutable std::array<std::atomic<int>, ring_size> pointer_usage = { 0 };
-    std::atomic<int> current_read_pointer = { 0 };
-    std::atomic<int> current_write_pointer = { 1 % ring_size };
-};
+    // takes a retired value which is referenced neither by the ring nor by any reader,
+    // so the writer can refill it in place and publish it instead of allocating a new one.
+    // returns empty pointer when every retired value is still in use
+    std::shared_ptr<T> acquire_recycled() {
+        for (int idx = 0; idx < static_cast<int>(ring_size); ++idx) {
+            if (!claim_retired(idx)) {
+                continue;
+            }
 
-const size_t reader_count = 4;
-const size_t writer_count = 2;
-const size_t iterations = 1000000;
-const auto writers_interval = std::chrono::nanoseconds(1);
+            // nobody can copy pointer while we own it, so unique pointer stays unique
+            if (pointers[idx] && pointers[idx].use_count() == 1) {
+                // order with the last reader's release of its copy
+                std::atomic_thread_fence(std::memory_order_acquire);
+                std::shared_ptr<T> result = std::move(pointers[idx]);
+                leave_vacant(idx);
+                return result;
+            }
 
-template<template<typename> typename atomic_shared_ptr>
-void run_test() {
-    atomic_shared_ptr<size_t> shared_ptr = std::make_shared<size_t>(0);
+            pointer_usage[idx].fetch_sub(under_construction_label);
+            pointer_usage[idx].fetch_sub(1);
+        }
+        return {};
+    }
 
-    std::vector<std::thread> readers(reader_count);
-    std::vector<std::thread> writers(writer_count);
+    // bring the state read by the next conversion into cache, first the read index and then
+    // the slot it points to, see load_many()
+    void prefetch_read_pointer() const {
+        prefetch(&current_read_pointer);
+    }
 
-    size_t sums[reader_count][writer_count + 1] = { 0 };
+    void prefetch_current() const {
+        auto idx = current_read_pointer.load(std::memory_order_relaxed);
+        prefetch(&pointer_usage[idx]);
+        prefetch(&pointers[idx]);
+    }
 
-    std::atomic_bool enable_writers = true;
-    for (size_t writer = 0; writer < writer_count; ++writer) {
-        writers[writer] = std::thread([&shared_ptr, &enable_writers, writer]() {
-            auto local = std::make_shared<size_t>(writer + 1);
-            while (enable_writers) {
-                std::this_thread::sleep_for(writers_interval);
-                shared_ptr = local;
+    // drops stale values kept by the ring, returns how many were dropped.
+    // values still referenced by readers are destroyed by the last of them
+    size_t release_retired() {
+        size_t released = 0;
+        for (int idx = 0; idx < static_cast<int>(ring_size); ++idx) {
+            if (!claim_retired(idx)) {
+                continue;
             }
-        });
+            if (pointers[idx]) {
+                pointers[idx].reset();
+                ++released;
+            }
+            leave_vacant(idx);
+        }
+        return released;
     }
 
-    auto start = std::chrono::steady_clock::now();
+    // release stale values right after every publish instead of keeping them until reuse
+    void set_eager_release(bool enabled) {
+        eager_release = enabled;
+    }
 
-    for (size_t reader = 0; reader < reader_count; ++reader) {
-        readers[reader] = std::thread([&shared_ptr, &sums = sums[reader]]() {
-            for (size_t i = 0; i < iterations; ++i) {
-                std::shared_ptr<size_t> local_ptr = shared_ptr;
-                sums[*local_ptr]++;
-            }
-        });
+    // how many times readers and writers had to retry, a measure of contention
+    size_t retry_count() const {
+        return retries.load(std::memory_order_relaxed);
     }
-    for (auto& task : readers) {
-        task.join();
+
+    // number of stale values kept alive by the ring
+    size_t retained_count() const {
+        size_t count = 0;
+        for_each_retained([&count](const T&) { ++count; });
+        return count;
     }
 
-    auto end = std::chrono::steady_clock::now();
+    // memory kept alive by stale values, size_of should account for memory owned by T
+    template <typename SizeOf>
+    size_t retained_bytes(SizeOf size_of) const {
+        size_t bytes = 0;
+        for_each_retained([&bytes, &size_of](const T& value) { bytes += size_of(value); });
+        return bytes;
+    }
 
-    std::cout << iterations << " done in " <<
-        std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms\n";
+    size_t retained_bytes() const {
+        return retained_bytes([](const T&) { return sizeof(T); });
+    }
 
-    enable_writers = false;
-    for (auto& task : writers) {
-        task.join();
+private:
+    // the only writer owns current_write_pointer and knows which pointer is active,
+    // so it needs no cursor RMW and no self-usage record. the claim itself stays a single RMW:
+    // a reader holding a stale index may still bump usage of the pointer we are going to take.
+    // without the self-usage record the pointer is made active before it is degradated, otherwise
+    // claim_retired() could take it in between, and readers coming meanwhile back off for a moment
+    atomic_shared_ptr_with_ring& assign_from_single_writer(const std::shared_ptr<T>& p) {
+        auto active = current_read_pointer.load(std::memory_order_relaxed);
+        auto idx = current_write_pointer.load(std::memory_order_relaxed);
+        for (;; idx = static_cast<int>((idx + 1) % ring_size)) {
+            if (idx == active) {
+                continue;
+            }
+            auto usage = pointer_usage[idx].load(std::memory_order_relaxed);
+            if (usage >= under_construction_label) {
+                // left vacant, readers already skip it. release_retired() or acquire_recycled() called
+                // from another thread may be holding it above the label right now, so take it only
+                // when nobody is
+                int vacant = under_construction_label;
+                if (pointer_usage[idx].compare_exchange_strong(vacant, under_construction_label)) {
+                    break;
+                }
+                continue;
+            }
+            if (usage != 0) {
+                // still read by somebody, don't even try
+                continue;
+            }
+            if (pointer_usage[idx].fetch_add(under_construction_label) != 0) {
+                pointer_usage[idx].fetch_sub(under_construction_label);
+                continue;
+            }
+            break;
+        }
+        claimed_by[idx].store(current_thread_kernel_id(), std::memory_order_relaxed);
+        INJECTION_POINT();
+        pointers[idx] = p;
+        INJECTION_POINT();
+        current_read_pointer = idx;
+        INJECTION_POINT();
+        pointer_usage[idx].fetch_sub(under_construction_label);
+        current_write_pointer.store(static_cast<int>((idx + 1) % ring_size), std::memory_order_relaxed);
+        if (eager_release) {
+            release_retired();
+        }
+        return *this;
     }
 
-    //for (size_t reader = 0; reader < reader_count; ++reader) {
-    //    std::cout << "Reader " << reader << " :";
-    //    for (size_t writer = 0; writer <= writer_count; ++writer) {
-    //        std::cout << " " << 100.0 * sums[reader][writer] / iterations << "% (" << sums[reader][writer] << ")";
-    //    }
-    //    std::cout << "\n";
-    //}
-}
+    // takes exclusive ownership on non-active pointer, same way as writers do
+    bool claim_retired(int idx) {
+        pointer_usage[idx].fetch_add(1);
 
-int main()
-{
-    std::cout << "regular shared_ptr impl\n";
-    run_test<std::shared_ptr>();
-    run_test<std::shared_ptr>();
-    run_test<std::shared_ptr>();
+        int expected = 1;
+        INJECTION_POINT();
+        if (idx == current_read_pointer || INJECTED_FAILURE() ||
+            !pointer_usage[idx].compare_exchange_strong(expected, under_construction_label + 1)) {
+            pointer_usage[idx].fetch_sub(1);
+            return false;
+        }
+        INJECTION_POINT();
+        // a writer may have published idx between our check and the claim, its release of usage
+        // is what our claim observed, so its store of the read pointer is visible by now
+        if (idx == current_read_pointer) {
+            pointer_usage[idx].fetch_sub(under_construction_label);
+            pointer_usage[idx].fetch_sub(1);
+            return false;
+        }
+        claimed_by[idx].store(current_thread_kernel_id(), std::memory_order_relaxed);
+        return true;
+    }
 
-    std::cout << "mutex impl\n";
-    run_test<naive_atomic_shared_ptr_with_mutex>();
-    run_test<naive_atomic_shared_ptr_with_mutex>();
-    run_test<naive_atomic_shared_ptr_with_mutex>();
+    // leave pointer under construction, readers will skip it and writers will refill it
+    void leave_vacant(int idx) {
+        pointer_usage[idx].fetch_sub(1);
+    }
 
-    std::cout << "std::atomic impl\n";
-    run_test<atomic_shared_ptr_using_std_atomic>();
+    static void back_off() {
+        for (unsigned i = 0; i < retry_backoff; ++i) {
+            cpu_relax();
+        }
+    }
+
+    // on wide rings probing slot by slot dominates publishing, so writers first look for a free
+    // slot in the packed usage counters, a group of them per vector compare. it's only a hint,
+    // the claim checks the slot again. falls back to start when every slot is busy
+    static constexpr size_t scan_group = 4;
+    static constexpr bool scan_for_free_slots = ring_size >= 16 && ring_size % scan_group == 0 && !padded_usage;
+
+    size_t find_free_slot(size_t start) const {
+        constexpr size_t group_count = ring_size / scan_group;
+        auto read_idx = static_cast<size_t>(current_read_pointer.load(std::memory_order_relaxed));
+        for (size_t n = 0, group = start / scan_group; n < group_count; ++n, group = (group + 1) % group_count) {
+            auto mask = free_slot_mask(group * scan_group);
+            if (read_idx / scan_group == group) {
+                mask &= ~(1u << (read_idx % scan_group));
+            }
+            for (size_t lane = 0; lane < scan_group; ++lane) {
+                if (mask & (1u << lane)) {
+                    return group * scan_group + lane;
+                }
+            }
+        }
+        return start;
+    }
+
+    // bit per slot of the group which is neither used nor under construction by someone else
+    unsigned free_slot_mask(size_t first) const {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        static_assert(sizeof(usage_counter) == sizeof(int), "usage counters must be packed for the scan");
+        // aligned 4-byte lanes are read whole, a torn group only makes the hint stale
+        auto usage = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pointer_usage[first]));
+        auto free = _mm_or_si128(_mm_cmpeq_epi32(usage, _mm_setzero_si128()),
+            _mm_cmpeq_epi32(usage, _mm_set1_epi32(under_construction_label)));
+        return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(free)));
+#else
+        unsigned mask = 0;
+        for (size_t lane = 0; lane < scan_group; ++lane) {
+            auto usage = pointer_usage[first + lane].load(std::memory_order_relaxed);
+            if (usage == 0 || usage == under_construction_label) {
+                mask |= 1u << lane;
+            }
+        }
+        return mask;
+#endif
+    }
+
+    struct alignas(cache_line_size) padded_usage_counter : std::atomic<int> {
+        using std::atomic<int>::atomic;
+    };
+    using usage_counter = std::conditional_t<padded_usage, padded_usage_counter, std::atomic<int>>;
+
+    // visits stale values under read usage, so writers can't replace them meanwhile
+    template <typename F>
+    void for_each_retained(F f) const {
+        for (int idx = 0; idx < static_cast<int>(ring_size); ++idx) {
+            auto usage = pointer_usage[idx].fetch_add(1);
+            if (usage < under_construction_label && idx != current_read_pointer && pointers[idx]) {
+                f(*pointers[idx]);
+            }
+            pointer_usage[idx].fetch_sub(1);
+        }
+    }
+
+    std::array<std::shared_ptr<T>, ring_size> pointers;
+    mutable std::array<usage_counter, ring_size> pointer_usage = { 0 };
+    // kernel id of the last writer which claimed the pointer, readers bouncing off it watch that writer
+    std::array<std::atomic<int>, ring_size> claimed_by = {};
+    std::atomic<int> current_read_pointer = { 0 };
+    std::atomic<int> current_write_pointer = { 1 % ring_size };
+    std::atomic_bool eager_release = { false };
+    mutable std::atomic<size_t> retries = { 0 };
+};
+
+template <typename T>
+using atomic_shared_ptr_with_single_writer_ring = atomic_shared_ptr_with_ring<T, tuned_ring_size, true>;
+
+template <typename P, typename = void>
+struct has_prefetch_current : std::false_type {};
+
+template <typename P>
+struct has_prefetch_current<P, std::void_t<decltype(std::declval<const P&>().prefetch_current())>> : std::true_type {};
+
+// loads count independent pointers into out. loading them one by one serializes their cache misses,
+// so the state of later pointers is prefetched in two stages while earlier ones are copied:
+// the read index load_distance ahead and the slot it points to half as far
+template <typename AtomicSharedPtr, typename T>
+void load_many(const AtomicSharedPtr* const* sources, size_t count, std::shared_ptr<T>* out) {
+    constexpr size_t load_distance = 8;
+    constexpr size_t slot_distance = load_distance / 2;
+
+    auto prefetch_first_stage = [&](size_t i) {
+        if constexpr (has_prefetch_current<AtomicSharedPtr>::value) {
+            sources[i]->prefetch_read_pointer();
+        } else {
+            prefetch(sources[i]);
+        }
+    };
+    auto prefetch_second_stage = [&](size_t i) {
+        if constexpr (has_prefetch_current<AtomicSharedPtr>::value) {
+            sources[i]->prefetch_current();
+        }
+    };
+
+    for (size_t i = 0; i < std::min(count, load_distance); ++i) {
+        prefetch_first_stage(i);
+    }
+    for (size_t i = 0; i < std::min(count, slot_distance); ++i) {
+        prefetch_second_stage(i);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (i + load_distance < count) {
+            prefetch_first_stage(i + load_distance);
+        }
+        if (i + slot_distance < count) {
+            prefetch_second_stage(i + slot_distance);
+        }
+        out[i] = *sources[i];
+    }
+}
+
+// latest-value channel for exactly one reader and one writer. values are copied into
+// one of three preallocated buffers, the writer and the reader swap their buffer
+// with the middle one, so both sides are wait-free and no refcount is touched
+template <typename T>
+class spsc_triple_buffer {
+public:
+    // initialization is not atomic and thread safe
+    spsc_triple_buffer(const std::shared_ptr<T>& p) {
+        for (auto& buffer : buffers) {
+            buffer.value = *p;
+        }
+    }
+
+    // buffer owned by the writer, fill it in place and publish()
+    T& write_buffer() {
+        return buffers[back].value;
+    }
+
+    void publish() {
+        INJECTION_POINT();
+        back = middle.exchange(back | dirty_flag, std::memory_order_acq_rel) & index_mask;
+    }
+
+    spsc_triple_buffer& operator=(const std::shared_ptr<T>& p) {
+        write_buffer() = *p;
+        publish();
+        return *this;
+    }
+
+    // returned value stays untouched until the next read by the same reader
+    const T& read() const {
+        if (middle.load(std::memory_order_relaxed) & dirty_flag) {
+            INJECTION_POINT();
+            front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+        }
+        return buffers[front].value;
+    }
+
+    // non-owning pointer with the same lifetime as read() result
+    operator std::shared_ptr<T>() const {
+        return std::shared_ptr<T>(std::shared_ptr<T>(), const_cast<T*>(&read()));
+    }
+
+private:
+    static constexpr int index_mask = 3;
+    static constexpr int dirty_flag = 4;
+
+    struct alignas(cache_line_size) buffer {
+        T value;
+    };
+
+    std::array<buffer, 3> buffers;
+    alignas(cache_line_size) mutable std::atomic<int> middle = { 1 };
+    alignas(cache_line_size) int back = 2;
+    alignas(cache_line_size) mutable int front = 0;
+};
+
+// per-thread records for schemes which scan the state of all threads. a thread gets its record on first
+// local() call and gives it back on exit, records are reused by later threads, so scans cost
+// O(max concurrent threads) rather than O(threads ever). records are never freed while the registry
+// or any registered thread is alive, so scanners iterate them without locks. a record must be back
+// in its neutral state when its thread stops using it, scanners see free records as well
+template <typename Record>
+class thread_registry {
+    struct alignas(cache_line_size) slot {
+        Record record;
+        std::atomic_bool in_use = { false };
+        slot* next = nullptr;
+    };
+
+    struct state {
+        std::atomic<slot*> head = { nullptr };
+        std::atomic<size_t> size = { 0 };
+
+        ~state() {
+            for (auto current = head.load(); current;) {
+                delete std::exchange(current, current->next);
+            }
+        }
+    };
+
+public:
+    thread_registry() : shared(std::make_shared<state>()), id(next_id++) {}
+
+    thread_registry(const thread_registry&) = delete;
+    thread_registry& operator=(const thread_registry&) = delete;
+
+    Record& local() const {
+        auto& registrations = thread_registrations();
+        if (registrations.last_id == id) {
+            return registrations.last->record;
+        }
+        for (auto& registration : registrations.entries) {
+            if (registration.id == id) {
+                registrations.cache(registration);
+                return registration.taken->record;
+            }
+        }
+        registrations.prune();
+        registrations.entries.push_back({ id, shared, take() });
+        registrations.cache(registrations.entries.back());
+        return registrations.last->record;
+    }
+
+    // visits records of all threads, including free ones
+    template <typename F>
+    void for_each(F f) const {
+        for (auto current = shared->head.load(std::memory_order_acquire); current; current = current->next) {
+            f(current->record);
+        }
+    }
+
+    // number of records ever allocated, that is max number of concurrently registered threads
+    size_t size() const {
+        return shared->size.load(std::memory_order_relaxed);
+    }
+
+    size_t active() const {
+        size_t count = 0;
+        for (auto current = shared->head.load(std::memory_order_acquire); current; current = current->next) {
+            count += current->in_use.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+private:
+    struct registration {
+        uint64_t id;
+        std::shared_ptr<state> owner;
+        slot* taken;
+
+        registration(uint64_t id, std::shared_ptr<state> owner, slot* taken) :
+            id(id), owner(std::move(owner)), taken(taken) {}
+
+        registration(registration&& other) noexcept :
+            id(other.id), owner(std::move(other.owner)), taken(std::exchange(other.taken, nullptr)) {}
+
+        registration& operator=(registration&& other) noexcept {
+            std::swap(id, other.id);
+            std::swap(owner, other.owner);
+            std::swap(taken, other.taken);
+            return *this;
+        }
+
+        ~registration() {
+            if (taken) {
+                taken->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    struct registrations_of_thread {
+        std::vector<registration> entries;
+        uint64_t last_id = 0;
+        slot* last = nullptr;
+
+        void cache(const registration& entry) {
+            last_id = entry.id;
+            last = entry.taken;
+        }
+
+        // forget registries which were destroyed meanwhile
+        void prune() {
+            entries.erase(std::remove_if(entries.begin(), entries.end(),
+                [](const registration& entry) { return entry.owner.use_count() == 1; }), entries.end());
+            last_id = 0;
+            last = nullptr;
+        }
+    };
+
+    static registrations_of_thread& thread_registrations() {
+        static thread_local registrations_of_thread registrations;
+        return registrations;
+    }
+
+    slot* take() const {
+        for (auto current = shared->head.load(std::memory_order_acquire); current; current = current->next) {
+            bool expected = false;
+            if (!current->in_use.load(std::memory_order_relaxed) && !INJECTED_FAILURE() &&
+                current->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return current;
+            }
+        }
+        auto created = new slot();
+        created->in_use.store(true, std::memory_order_relaxed);
+        created->next = shared->head.load(std::memory_order_relaxed);
+        while (!shared->head.compare_exchange_weak(created->next, created, std::memory_order_release)) {
+        }
+        shared->size.fetch_add(1, std::memory_order_relaxed);
+        return created;
+    }
+
+    inline static std::atomic<uint64_t> next_id = { 1 };
+
+    const std::shared_ptr<state> shared;
+    const uint64_t id;
+};
+
+// ring which stops counting readers once writers are idle. after idle_interval without
+// publishes the value is frozen: readers only announce themselves in their per-thread record
+// and copy the frozen value. the next writer thaws it and waits until all frozen readers leave
+template <typename T, size_t ring_size = tuned_ring_size>
+class atomic_shared_ptr_with_read_phase {
+public:
+    // initialization is not atomic and thread safe
+    atomic_shared_ptr_with_read_phase(const std::shared_ptr<T>& p,
+        std::chrono::nanoseconds idle_interval = std::chrono::milliseconds(10)) :
+        ring(p), idle_interval(idle_interval), last_publish(now()) {}
+
+    atomic_shared_ptr_with_read_phase& operator=(const std::shared_ptr<T>& p) {
+        if (phase.load() & frozen_bit) {
+            std::lock_guard guard(mode_mutex);
+            thaw();
+        }
+        ring = p;
+        last_publish.store(now(), std::memory_order_relaxed);
+        INJECTION_POINT();
+        // a reader froze an older value meanwhile, it must not outlive this publish
+        if (phase.fetch_add(publish_step) & frozen_bit) {
+            std::lock_guard guard(mode_mutex);
+            thaw();
+        }
+        return *this;
+    }
+
+    operator std::shared_ptr<T>() const {
+        auto& record = reader_records.local();
+        record.readers.fetch_add(1);
+        INJECTION_POINT();
+        if (phase.load() & frozen_bit) {
+            INJECTION_POINT();
+            std::shared_ptr<T> result = frozen_value;
+            record.readers.fetch_sub(1, std::memory_order_release);
+            return result;
+        }
+        record.readers.fetch_sub(1, std::memory_order_relaxed);
+
+        static thread_local unsigned reads_since_check = 0;
+        if (++reads_since_check % idle_check_period == 0 &&
+            now() - last_publish.load(std::memory_order_relaxed) > idle_interval.count()) {
+            freeze();
+        }
+        return ring;
+    }
+
+    // drops stale values kept by the underlying ring
+    size_t release_retired() {
+        return ring.release_retired();
+    }
+
+    // number of per-thread reader records, grows only with the number of concurrent readers
+    size_t registry_size() const {
+        return reader_records.size();
+    }
+
+private:
+    static constexpr unsigned idle_check_period = 1024;
+    static constexpr size_t frozen_bit = 1;
+    static constexpr size_t publish_step = 2;
+
+    struct reader_record {
+        std::atomic<int> readers = { 0 };
+    };
+
+    static long long now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void freeze() const {
+        std::unique_lock lock(mode_mutex, std::try_to_lock);
+        auto published = phase.load();
+        if (!lock || (published & frozen_bit)) {
+            return;
+        }
+        // nobody reads frozen_value while thawed. a publish after the copy fails the exchange,
+        // a writer which passed the copy but not the publish count thaws it again on its own
+        frozen_value = ring;
+        INJECTION_POINT();
+        if (!phase.compare_exchange_strong(published, published | frozen_bit)) {
+            frozen_value.reset();
+        }
+    }
+
+    // must be called under mode_mutex
+    void thaw() const {
+        if (!(phase.load(std::memory_order_relaxed) & frozen_bit)) {
+            return;
+        }
+        phase.fetch_and(~frozen_bit);
+        // grace period: readers which came after the flip don't touch frozen_value,
+        // so seeing each record empty once is enough. seq_cst pairs with the readers' increment
+        // and phase load, either they see the flip or we see their increment
+        reader_records.for_each([](reader_record& record) {
+            while (record.readers.load() != 0) {
+                std::this_thread::yield();
+            }
+        });
+        frozen_value.reset();
+    }
+
+    atomic_shared_ptr_with_ring<T, ring_size> ring;
+    const std::chrono::nanoseconds idle_interval;
+    std::atomic<long long> last_publish;
+    // publish count in the upper bits, frozen flag in the lowest one
+    mutable std::atomic<size_t> phase = { 0 };
+    mutable std::shared_ptr<T> frozen_value;
+    mutable std::mutex mode_mutex;
+    thread_registry<reader_record> reader_records;
+};
+
+// switches between mutex, ring and read phase implementations depending on observed load.
+// readers just go to the active implementation and count their reads in per-thread records every
+// adapt_check_period reads. writers pass a gate which a switch closes, so no write lands in the
+// old implementation after the value was moved over. the old one keeps its last value, a reader
+// which picked it before the switch reads the value current at that time. once per sample_interval
+// the load is evaluated and, if another implementation fits better, the value is moved over
+template <typename T>
+class adaptive_atomic_shared_ptr {
+public:
+    enum class strategy { mutex, ring, read_phase };
+
+    // initialization is not atomic and thread safe
+    adaptive_atomic_shared_ptr(const std::shared_ptr<T>& p) :
+        with_mutex(p), with_ring(nullptr), with_read_phase(nullptr), last_sample(now()) {}
+
+    adaptive_atomic_shared_ptr& operator=(const std::shared_ptr<T>& p) {
+        enter_writer();
+        switch (active.load(std::memory_order_relaxed)) {
+        case strategy::mutex: with_mutex = p; break;
+        case strategy::ring: with_ring = p; break;
+        case strategy::read_phase: with_read_phase = p; break;
+        }
+        leave_writer();
+        records.local().writes.fetch_add(1, std::memory_order_relaxed);
+        adapt();
+        return *this;
+    }
+
+    operator std::shared_ptr<T>() const {
+        std::shared_ptr<T> result;
+        // pairs with the store in switch_to(), the new implementation is filled by then
+        switch (active.load(std::memory_order_acquire)) {
+        case strategy::mutex: result = with_mutex; break;
+        case strategy::ring: result = with_ring; break;
+        case strategy::read_phase: result = with_read_phase; break;
+        }
+
+        static thread_local unsigned reads_since_check = 0;
+        if (++reads_since_check % adapt_check_period == 0) {
+            records.local().reads.fetch_add(adapt_check_period, std::memory_order_relaxed);
+            adapt();
+        }
+        return result;
+    }
+
+    strategy current_strategy() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // per-thread records of this and the read phase implementation
+    size_t registry_size() const {
+        return records.size() + with_read_phase.registry_size();
+    }
+
+private:
+    static constexpr unsigned adapt_check_period = 1024;
+    static constexpr auto sample_interval = std::chrono::milliseconds(10);
+    // ring is thrashing when readers and writers retry more often than this per write
+    static constexpr size_t ring_retries_per_write = 4;
+    // writers inside in the lower bits
+    static constexpr size_t gate_closed = size_t(1) << (std::numeric_limits<size_t>::digits - 1);
+
+    struct thread_record {
+        std::atomic<size_t> reads = { 0 };
+        std::atomic<size_t> writes = { 0 };
+        size_t sampled_reads = 0;
+        size_t sampled_writes = 0;
+    };
+
+    static long long now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void enter_writer() const {
+        for (;;) {
+            // one RMW word with the switch, so either it waits for us or we see it closed
+            if (!(writer_gate.fetch_add(1, std::memory_order_acquire) & gate_closed)) {
+                return;
+            }
+            writer_gate.fetch_sub(1, std::memory_order_relaxed);
+            INJECTION_POINT();
+            while (writer_gate.load(std::memory_order_relaxed) & gate_closed) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void leave_writer() const {
+        writer_gate.fetch_sub(1, std::memory_order_release);
+    }
+
+    void adapt() const {
+        auto sample_start = last_sample.load(std::memory_order_relaxed);
+        auto sample_end = now();
+        if (sample_end - sample_start < std::chrono::nanoseconds(sample_interval).count()) {
+            return;
+        }
+        std::unique_lock lock(adapt_mutex, std::try_to_lock);
+        if (!lock) {
+            return;
+        }
+        last_sample.store(sample_end, std::memory_order_relaxed);
+
+        size_t readers = 0;
+        size_t reads = 0;
+        size_t writes = 0;
+        records.for_each([&](thread_record& record) {
+            auto record_reads = record.reads.load(std::memory_order_relaxed);
+            auto record_writes = record.writes.load(std::memory_order_relaxed);
+            if (record_reads != record.sampled_reads) {
+                ++readers;
+            }
+            reads += record_reads - record.sampled_reads;
+            writes += record_writes - record.sampled_writes;
+            record.sampled_reads = record_reads;
+            record.sampled_writes = record_writes;
+        });
+        auto ring_retries = with_ring.retry_count();
+        auto retries = ring_retries - sampled_ring_retries;
+        sampled_ring_retries = ring_retries;
+
+        auto current = active.load(std::memory_order_relaxed);
+        auto next = current;
+        if (writes == 0) {
+            // read-only stretch, let readers skip usage counters
+            next = reads != 0 ? strategy::read_phase : current;
+        } else if (readers <= 1) {
+            // uncontended mutex is the cheapest one
+            next = strategy::mutex;
+        } else if (current == strategy::ring && retries > writes * ring_retries_per_write) {
+            next = strategy::mutex;
+        } else if (current != strategy::ring) {
+            next = strategy::ring;
+        }
+
+        // switch only when the same choice is made twice in a row
+        if (next == current || next != proposed) {
+            proposed = next;
+            return;
+        }
+        switch_to(next);
+    }
+
+    // must be called under adapt_mutex
+    void switch_to(strategy next) const {
+        // writers which passed the gate must finish in the old implementation
+        writer_gate.fetch_or(gate_closed, std::memory_order_acquire);
+        while ((writer_gate.load(std::memory_order_acquire) & ~gate_closed) != 0) {
+            std::this_thread::yield();
+        }
+        INJECTION_POINT();
+
+        // readers may still be in the old implementation, so it keeps the value
+        std::shared_ptr<T> value;
+        switch (active.load(std::memory_order_relaxed)) {
+        case strategy::mutex: value = with_mutex; break;
+        case strategy::ring: value = with_ring; with_ring.release_retired(); break;
+        case strategy::read_phase: value = with_read_phase; with_read_phase.release_retired(); break;
+        }
+        switch (next) {
+        case strategy::mutex: with_mutex = value; break;
+        case strategy::ring: with_ring = value; break;
+        case strategy::read_phase: with_read_phase = value; break;
+        }
+
+        active.store(next, std::memory_order_release);
+        writer_gate.fetch_and(~gate_closed, std::memory_order_release);
+    }
+
+    mutable naive_atomic_shared_ptr_with_mutex<T> with_mutex;
+    mutable atomic_shared_ptr_with_ring<T> with_ring;
+    mutable atomic_shared_ptr_with_read_phase<T> with_read_phase;
+    mutable std::atomic<strategy> active = { strategy::mutex };
+    mutable std::atomic<size_t> writer_gate = { 0 };
+    mutable std::mutex adapt_mutex;
+    mutable std::atomic<long long> last_sample;
+    mutable strategy proposed = strategy::mutex;
+    mutable size_t sampled_ring_retries = 0;
+    thread_registry<thread_record> records;
+};
+
+// reference counted node which may be released through per-thread decrement buffers
+struct deferred_rc_node {
+    std::atomic<int64_t> refs = { 1 };
+    void (*destroy)(deferred_rc_node*) = nullptr;
+};
+
+// decrements are appended to a buffer of the releasing thread and applied in batches by reconcile(),
+// consecutive decrements of the same node are merged. nodes are freed only during reconciliation
+class deferred_decrements {
+public:
+    static void release(deferred_rc_node* node) {
+        static thread_local exit_reconciler reconciler;
+        (void)reconciler;
+        if (buffered != 0 && buffer[buffered - 1].node == node) {
+            ++buffer[buffered - 1].count;
+            return;
+        }
+        if (buffered == buffer_size) {
+            reconcile();
+        }
+        buffer[buffered++] = { node, 1 };
+    }
+
+    static void release_now(deferred_rc_node* node, int64_t count) {
+        if (node->refs.fetch_sub(count, std::memory_order_acq_rel) == count) {
+            node->destroy(node);
+        }
+    }
+
+    // applies decrements buffered by the calling thread
+    static void reconcile() {
+        // node destruction may release other nodes, so take the batch out first
+        pending batch[buffer_size];
+        auto count = buffered;
+        std::copy(buffer, buffer + count, batch);
+        buffered = 0;
+        for (size_t i = 0; i < count; ++i) {
+            release_now(batch[i].node, batch[i].count);
+        }
+    }
+
+private:
+    static constexpr size_t buffer_size = 64;
+
+    struct pending {
+        deferred_rc_node* node;
+        int64_t count;
+    };
+
+    struct exit_reconciler {
+        ~exit_reconciler() {
+            reconcile();
+        }
+    };
+
+    // trivially destructible, so it stays usable while other thread locals are destroyed
+    inline static thread_local pending buffer[buffer_size];
+    inline static thread_local size_t buffered = 0;
+};
+
+// deferred reference counting: a reader thread takes one reference per published version and hands out
+// copies of its own thread-local shared_ptr, so per-read increments and decrements hit a control block
+// nobody else touches. the thread's reference is dropped into its decrement buffer once the version is
+// replaced in its cache and all copies are gone. readers take the version reference with split counting:
+// a borrow is added to the current pointer word and then moved to the node itself. the buffer is applied
+// whenever a thread moves to a new version, so it keeps at most the versions its own copies still hold
+template <typename T>
+class atomic_shared_ptr_with_deferred_rc {
+public:
+    // initialization is not atomic and thread safe
+    atomic_shared_ptr_with_deferred_rc(const std::shared_ptr<T>& p) :
+        current(word_of(new version(p))), id(next_id++) {}
+
+    ~atomic_shared_ptr_with_deferred_rc() {
+        deferred_decrements::release_now(node_of(current.load()), 1);
+    }
+
+    atomic_shared_ptr_with_deferred_rc& operator=(const std::shared_ptr<T>& p) {
+        auto previous = current.exchange(word_of(new version(p)));
+        // readers return borrows to the node once it is replaced, our own reference goes away
+        auto borrows = static_cast<int64_t>(previous >> pointer_bits);
+        auto node = node_of(previous);
+        if (node->refs.fetch_add(borrows - 1, std::memory_order_acq_rel) == 1 - borrows) {
+            node->destroy(node);
+        }
+        return *this;
+    }
+
+    operator std::shared_ptr<T>() const {
+        auto& entry = cached_entry();
+        if (entry.node == node_of(current.load(std::memory_order_acquire))) {
+            return entry.local;
+        }
+        auto node = acquire();
+        entry.node = node;
+        entry.local = std::shared_ptr<T>(node->value.get(), [node](T*) { deferred_decrements::release(node); });
+        // the version cached before is superseded, it must not wait for a whole batch
+        deferred_decrements::reconcile();
+        return entry.local;
+    }
+
+    // drops versions of destroyed instances cached by the calling thread and applies its buffered
+    // decrements, for threads which stop reading for a while
+    static void reconcile() {
+        prune(local_cache());
+        deferred_decrements::reconcile();
+    }
+
+private:
+    // pointer and borrow count share one 64-bit word, user space pointers of 64-bit targets fit in 48 bits
+    static constexpr int pointer_bits = sizeof(void*) == 8 ? 48 : 32;
+    static constexpr uint64_t pointer_mask = (uint64_t(1) << pointer_bits) - 1;
+    static constexpr uint64_t one_borrow = uint64_t(1) << pointer_bits;
+    static constexpr size_t max_cached_instances = 16;
+
+    struct version : deferred_rc_node {
+        explicit version(const std::shared_ptr<T>& p) : value(p) {
+            destroy = [](deferred_rc_node* node) { delete static_cast<version*>(node); };
+        }
+
+        std::shared_ptr<T> value;
+    };
+
+    struct cache_entry {
+        uint64_t owner = 0;
+        // expires with the owner, whose cached version is dropped then
+        std::weak_ptr<const char> owner_alive;
+        version* node = nullptr;
+        std::shared_ptr<T> local;
+    };
+
+    struct thread_cache {
+        std::vector<cache_entry> entries;
+
+        ~thread_cache() {
+            entries.clear();
+            deferred_decrements::reconcile();
+        }
+    };
+
+    static version* node_of(uint64_t word) {
+        return reinterpret_cast<version*>(static_cast<uintptr_t>(word & pointer_mask));
+    }
+
+    static uint64_t word_of(version* node) {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(node));
+    }
+
+    static thread_cache& local_cache() {
+        static thread_local thread_cache cache;
+        return cache;
+    }
+
+    static void prune(thread_cache& cache) {
+        cache.entries.erase(std::remove_if(cache.entries.begin(), cache.entries.end(),
+            [](const cache_entry& entry) { return entry.owner_alive.expired(); }), cache.entries.end());
+    }
+
+    cache_entry& cached_entry() const {
+        auto& cache = local_cache();
+        for (auto& entry : cache.entries) {
+            if (entry.owner == id) {
+                return entry;
+            }
+        }
+        prune(cache);
+        if (cache.entries.size() == max_cached_instances) {
+            cache.entries.erase(cache.entries.begin());
+        }
+        cache.entries.push_back({ id, alive, nullptr, nullptr });
+        return cache.entries.back();
+    }
+
+    version* acquire() const {
+        // borrowed reference keeps node alive until we own one
+        auto word = current.fetch_add(one_borrow) + one_borrow;
+        auto node = node_of(word);
+        INJECTION_POINT();
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+        // give the borrow back where it is accounted now
+        while (INJECTED_FAILURE() || !current.compare_exchange_weak(word, word - one_borrow)) {
+            if (node_of(word) != node) {
+                // writer has moved our borrow to the node
+                node->refs.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        return node;
+    }
+
+    inline static std::atomic<uint64_t> next_id = { 1 };
+
+    mutable std::atomic<uint64_t> current;
+    const uint64_t id;
+    const std::shared_ptr<const char> alive = std::make_shared<const char>();
+};
+
+inline uint64_t current_process_id() {
+#if defined(_WIN32)
+    return GetCurrentProcessId();
+#elif defined(__linux__)
+    return static_cast<uint64_t>(getpid());
+#else
+    return 1;
+#endif
+}
+
+// pid reuse may keep a dead process "alive", it only delays recovery of its resources
+inline bool process_alive(uint64_t pid) {
+#if defined(_WIN32)
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+    if (!process) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#elif defined(__linux__)
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#else
+    (void)pid;
+    return true;
+#endif
+}
+
+// named memory shared between processes, whoever opens it first creates and zero fills it
+class shared_memory_segment {
+public:
+    shared_memory_segment(const std::string& name, size_t size) : size(size) {
+#if defined(_WIN32)
+        handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), name.c_str());
+        if (!handle) {
+            throw std::system_error(GetLastError(), std::system_category(), "CreateFileMapping");
+        }
+        created = GetLastError() != ERROR_ALREADY_EXISTS;
+        address = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!address) {
+            auto error = GetLastError();
+            CloseHandle(handle);
+            throw std::system_error(error, std::system_category(), "MapViewOfFile");
+        }
+#elif defined(__linux__)
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        created = fd >= 0;
+        if (!created && errno == EEXIST) {
+            fd = shm_open(name.c_str(), O_RDWR, 0600);
+        }
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open");
+        }
+        if (created && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            auto error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::system_error(error, std::generic_category(), "ftruncate");
+        }
+        // creator may not have sized it yet, touching pages past the end would raise SIGBUS
+        struct stat status = {};
+        auto deadline = std::chrono::steady_clock::now() + creation_timeout;
+        while (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) < size) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                close(fd);
+                throw std::runtime_error("shared memory " + name + " was never sized, its creator may have died");
+            }
+            std::this_thread::yield();
+        }
+        address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        auto error = errno;
+        close(fd);
+        if (address == MAP_FAILED) {
+            throw std::system_error(error, std::generic_category(), "mmap");
+        }
+#else
+        (void)name;
+        throw std::runtime_error("shared memory is not supported on this platform");
+#endif
+    }
+
+    ~shared_memory_segment() {
+#if defined(_WIN32)
+        UnmapViewOfFile(address);
+        CloseHandle(handle);
+#elif defined(__linux__)
+        munmap(address, size);
+#endif
+    }
+
+    shared_memory_segment(const shared_memory_segment&) = delete;
+    shared_memory_segment& operator=(const shared_memory_segment&) = delete;
+
+    // how long others wait for the creator to set the segment up before giving up on it
+    static constexpr auto creation_timeout = std::chrono::seconds(5);
+
+    // removes the name, mapped segments stay valid (no-op on windows, mapping dies with the last handle)
+    static void unlink(const std::string& name) {
+#if defined(__linux__)
+        shm_unlink(name.c_str());
+#else
+        (void)name;
+#endif
+    }
+
+    char* data() const {
+        return static_cast<char*>(address);
+    }
+
+    bool is_creator() const {
+        return created;
+    }
+
+private:
+    size_t size;
+    void* address = nullptr;
+    bool created = false;
+#if defined(_WIN32)
+    HANDLE handle = nullptr;
+#endif
+};
+
+// latest published value shared by several processes without copying. values live in the segment,
+// so T must be trivially copyable and refer to other data by offsets only. every attached instance owns
+// a record with hazard slots: a reader announces the offset it is going to use there and the publisher
+// recycles a retired value only when no hazard points at it. records of crashed processes are recovered
+// by liveness check of their pid, publishers serialize on a lock which can be taken over the same way
+template <typename T, size_t max_versions = 16>
+class interprocess_atomic_shared_ptr {
+    static_assert(std::is_trivially_copyable_v<T>, "value must be placed in shared memory as is");
+    static_assert(alignof(T) <= cache_line_size, "value must fit block alignment");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomics must work across processes");
+
+public:
+    interprocess_atomic_shared_ptr(const std::string& name) : interprocess_atomic_shared_ptr(name, false) {}
+
+    // private segment, mostly for benchmarking alongside other implementations
+    interprocess_atomic_shared_ptr(const std::shared_ptr<T>& p) :
+        interprocess_atomic_shared_ptr(private_segment_name(), true) {
+        *this = p;
+    }
+
+    interprocess_atomic_shared_ptr(const interprocess_atomic_shared_ptr&) = delete;
+    interprocess_atomic_shared_ptr& operator=(const interprocess_atomic_shared_ptr&) = delete;
+
+    interprocess_atomic_shared_ptr& operator=(const std::shared_ptr<T>& p) {
+        publish(*p);
+        return *this;
+    }
+
+    // copies value into the segment and makes it current, throws std::bad_alloc
+    // when all max_versions values are still used by readers
+    void publish(const T& value) {
+        lock_publishers();
+        auto offset = allocate();
+        if (!offset) {
+            unlock_publishers();
+            throw std::bad_alloc();
+        }
+        new (value_at(offset)) T(value);
+        INJECTION_POINT();
+        auto previous = header->current.exchange(offset);
+        INJECTION_POINT();
+        if (previous) {
+            block_at(previous)->next = header->retired;
+            header->retired = previous;
+        }
+        unlock_publishers();
+    }
+
+    // value stays in place until the returned pointer and all its copies are gone
+    operator std::shared_ptr<T>() const {
+        for (;;) {
+            auto offset = header->current.load(std::memory_order_acquire);
+            if (!offset) {
+                return {};
+            }
+            auto hazard = claim_hazard(offset);
+            if (!hazard) {
+                return copy_current();
+            }
+            INJECTION_POINT();
+            // pairs with current exchange in publish() and hazard scan in reclaim()
+            if (header->current.load() != offset) {
+                hazard->store(0, std::memory_order_release);
+                continue;
+            }
+            return std::shared_ptr<T>(value_at(offset), [record = record, hazard](T*) {
+                hazard->store(0, std::memory_order_release);
+            });
+        }
+    }
+
+private:
+    static constexpr uint64_t segment_magic = 0x5348415245445054; // "SHAREDPT"
+    static constexpr size_t max_processes = 64;
+    static constexpr size_t hazards_per_process = 32;
+
+    struct alignas(cache_line_size) process_record {
+        std::atomic<uint64_t> pid = { 0 };
+        std::array<std::atomic<uint64_t>, hazards_per_process> hazards = {};
+    };
+
+    struct alignas(cache_line_size) segment_header {
+        std::atomic<uint64_t> magic = { 0 };
+        uint64_t block_size = 0;
+        uint64_t capacity = 0;
+        std::atomic<uint64_t> current = { 0 };
+        alignas(cache_line_size) std::atomic<uint64_t> publisher_pid = { 0 };
+        // guarded by publisher lock
+        uint64_t allocated = 0;
+        uint64_t free = 0;
+        uint64_t retired = 0;
+        std::array<process_record, max_processes> processes;
+    };
+
+    struct alignas(cache_line_size) block_header {
+        // free or retired list link, guarded by publisher lock
+        uint64_t next = 0;
+    };
+
+    static constexpr size_t block_size =
+        (sizeof(block_header) + sizeof(T) + cache_line_size - 1) / cache_line_size * cache_line_size;
+    static constexpr size_t segment_size = sizeof(segment_header) + max_versions * block_size;
+
+    interprocess_atomic_shared_ptr(const std::string& name, bool unlink_name) :
+        segment(std::make_shared<shared_memory_segment>(name, segment_size)),
+        header(reinterpret_cast<segment_header*>(segment->data())) {
+        if (segment->is_creator()) {
+            new (header) segment_header();
+            header->block_size = block_size;
+            header->capacity = max_versions;
+            header->magic.store(segment_magic, std::memory_order_release);
+        } else {
+            auto deadline = std::chrono::steady_clock::now() + shared_memory_segment::creation_timeout;
+            while (header->magic.load(std::memory_order_acquire) != segment_magic) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    throw std::runtime_error("shared memory " + name + " was never initialized, its creator may have died");
+                }
+                std::this_thread::yield();
+            }
+            if (header->block_size != block_size || header->capacity != max_versions) {
+                throw std::runtime_error("shared memory segment layout doesn't match");
+            }
+        }
+        if (unlink_name) {
+            shared_memory_segment::unlink(name);
+        }
+        attach();
+    }
+
+    static std::string private_segment_name() {
+        static std::atomic<unsigned> counter = { 0 };
+#if defined(_WIN32)
+        return "Local\\atomic_shared_ptr." + std::to_string(current_process_id()) + "." + std::to_string(counter++);
+#else
+        return "/atomic_shared_ptr." + std::to_string(current_process_id()) + "." + std::to_string(counter++);
+#endif
+    }
+
+    block_header* block_at(uint64_t offset) const {
+        return reinterpret_cast<block_header*>(segment->data() + offset);
+    }
+
+    T* value_at(uint64_t offset) const {
+        return reinterpret_cast<T*>(segment->data() + offset + sizeof(block_header));
+    }
+
+    void attach() {
+        auto pid = current_process_id();
+        for (;;) {
+            for (auto& candidate : header->processes) {
+                uint64_t expected = 0;
+                if (candidate.pid.compare_exchange_strong(expected, pid)) {
+                    // returned pointers hold hazards in the record, so it's given up after the last
+                    // of them and the instance are gone, not before somebody else could attach to it
+                    record = std::shared_ptr<process_record>(&candidate, [segment = segment](process_record* released) {
+                        released->pid.store(0, std::memory_order_release);
+                    });
+                    return;
+                }
+            }
+            recover_crashed();
+            std::this_thread::yield();
+        }
+    }
+
+    // returns nullptr when all hazards of this instance are held by outstanding pointers
+    std::atomic<uint64_t>* claim_hazard(uint64_t offset) const {
+        for (auto& hazard : record->hazards) {
+            uint64_t expected = 0;
+            if (hazard.load(std::memory_order_relaxed) == 0 && hazard.compare_exchange_strong(expected, offset)) {
+                return &hazard;
+            }
+        }
+        return nullptr;
+    }
+
+    // fallback when there is no free hazard, waiting for one could wait on the caller's own pointers.
+    // blocks are refilled only under the publisher lock, so a copy made under it needs no hazard
+    std::shared_ptr<T> copy_current() const {
+        auto copy = std::make_shared<T>();
+        lock_publishers();
+        auto offset = header->current.load(std::memory_order_acquire);
+        if (offset) {
+            *copy = *value_at(offset);
+        }
+        unlock_publishers();
+        return offset ? copy : nullptr;
+    }
+
+    void recover_crashed() const {
+        for (auto& candidate : header->processes) {
+            auto pid = candidate.pid.load();
+            if (pid && !process_alive(pid)) {
+                for (auto& hazard : candidate.hazards) {
+                    hazard.store(0);
+                }
+                candidate.pid.compare_exchange_strong(pid, 0);
+            }
+        }
+    }
+
+    void lock_publishers() const {
+        auto pid = current_process_id();
+        for (;;) {
+            uint64_t owner = 0;
+            if (header->publisher_pid.compare_exchange_strong(owner, pid)) {
+                return;
+            }
+            // lock left by a crashed publisher is taken over
+            if (owner != pid && !process_alive(owner) && header->publisher_pid.compare_exchange_strong(owner, pid)) {
+                recover_blocks();
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock_publishers() const {
+        header->publisher_pid.store(0, std::memory_order_release);
+    }
+
+    // must be called under publisher lock taken over from a crashed publisher. it may have died with
+    // a block taken from the free list, a replaced value not retired yet or a list half updated,
+    // so both lists are rebuilt: everything but the current value is retired and reclaim() frees
+    // what no hazard points at
+    void recover_blocks() const {
+        auto current = header->current.load();
+        header->free = 0;
+        header->retired = 0;
+        for (uint64_t index = 0; index < std::min(header->allocated, header->capacity); ++index) {
+            auto offset = sizeof(segment_header) + index * block_size;
+            if (offset != current) {
+                block_at(offset)->next = header->retired;
+                header->retired = offset;
+            }
+        }
+    }
+
+    // must be called under publisher lock
+    uint64_t allocate() {
+        if (!header->free) {
+            reclaim();
+        }
+        if (auto offset = header->free) {
+            header->free = block_at(offset)->next;
+            return offset;
+        }
+        if (header->allocated < header->capacity) {
+            return sizeof(segment_header) + header->allocated++ * block_size;
+        }
+        return 0;
+    }
+
+    // must be called under publisher lock
+    void reclaim() {
+        recover_crashed();
+        auto link = &header->retired;
+        while (auto offset = *link) {
+            auto block = block_at(offset);
+            if (is_protected(offset)) {
+                link = &block->next;
+                continue;
+            }
+            *link = block->next;
+            block->next = header->free;
+            header->free = offset;
+        }
+    }
+
+    bool is_protected(uint64_t offset) const {
+        for (auto& candidate : header->processes) {
+            for (auto& hazard : candidate.hazards) {
+                if (hazard.load() == offset) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<shared_memory_segment> segment;
+    segment_header* header;
+    // keeps the segment mapped as long as the record is in use
+    std::shared_ptr<process_record> record;
+};
+
+// value saved in a fixed layout file, so a restarted process can start from the last published state.
+// every store writes a new file and renames it over the old one: a crash never leaves a torn snapshot
+// and a mapping made by load() keeps seeing the file it was made from. no fsync, it survives process
+// restarts but not power loss
+template <typename T>
+class mapped_snapshot {
+    static_assert(std::is_trivially_copyable_v<T>, "value is stored as is");
+    static_assert(alignof(T) <= cache_line_size, "value must fit header alignment");
+
+public:
+    static void store(const std::string& path, const T& value) {
+        // unique per store, instances saving to the same path must not write into each other's file
+        auto temporary = path + ".tmp" + std::to_string(current_process_id()) + "." + std::to_string(temporaries++);
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            snapshot_header header;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            if (!file.flush()) {
+                throw std::runtime_error("can't write snapshot " + temporary);
+            }
+        }
+        INJECTION_POINT();
+#if defined(_WIN32)
+        if (!MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            throw std::system_error(GetLastError(), std::system_category(), "MoveFileEx");
+        }
+#else
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::system_error(errno, std::generic_category(), "rename");
+        }
+#endif
+    }
+
+    // maps saved value copy-on-write without reading it, returns empty pointer if there is no valid snapshot.
+    // windows can't replace a mapped file, so there the value is read into memory
+    static std::shared_ptr<T> load(const std::string& path) {
+#if defined(__linux__)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return {};
+        }
+        struct stat status = {};
+        if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) != file_size) {
+            close(fd);
+            return {};
+        }
+        auto address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED) {
+            return {};
+        }
+        auto header = static_cast<snapshot_header*>(address);
+        if (!header->valid()) {
+            munmap(address, file_size);
+            return {};
+        }
+        return std::shared_ptr<T>(reinterpret_cast<T*>(header + 1), [address](T*) { munmap(address, file_size); });
+#else
+        std::ifstream file(path, std::ios::binary);
+        snapshot_header header;
+        header.magic = 0;
+        auto result = std::make_shared<T>();
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !header.valid() ||
+            !file.read(reinterpret_cast<char*>(result.get()), sizeof(T))) {
+            return {};
+        }
+        return result;
+#endif
+    }
+
+private:
+    static constexpr uint64_t snapshot_magic = 0x534e415053484f54; // "SNAPSHOT"
+
+    struct alignas(cache_line_size) snapshot_header {
+        uint64_t magic = snapshot_magic;
+        uint64_t value_size = sizeof(T);
+
+        bool valid() const {
+            return magic == snapshot_magic && value_size == sizeof(T);
+        }
+    };
+
+    static constexpr size_t file_size = sizeof(snapshot_header) + sizeof(T);
+
+    inline static std::atomic<uint64_t> temporaries = { 0 };
+};
+
+// saves every published value to a snapshot file and starts from the saved one, so restarts
+// don't wait for the real source. publishes are serialized to keep the file in line with the current value
+template <typename T, typename atomic_shared_ptr = atomic_shared_ptr_with_ring<T>>
+class persistent_atomic_shared_ptr {
+public:
+    // fallback is used when there is no valid snapshot yet
+    persistent_atomic_shared_ptr(const std::string& path, const std::shared_ptr<T>& fallback) :
+        path(path), pointer(initial_value(path, fallback)) {}
+
+    persistent_atomic_shared_ptr& operator=(const std::shared_ptr<T>& p) {
+        std::lock_guard guard(persist_mutex);
+        pointer = p;
+        INJECTION_POINT();
+        mapped_snapshot<T>::store(path, *p);
+        return *this;
+    }
+
+    operator std::shared_ptr<T>() const {
+        return pointer;
+    }
+
+private:
+    static std::shared_ptr<T> initial_value(const std::string& path, const std::shared_ptr<T>& fallback) {
+        auto snapshot = mapped_snapshot<T>::load(path);
+        return snapshot ? snapshot : fallback;
+    }
+
+    const std::string path;
+    atomic_shared_ptr pointer;
+    std::mutex persist_mutex;
+};
+
+// publish versions of many pointers in one dense array plus a dirty bitmap, so watchers find
+// the pointers changed since their last sweep with a vector scan instead of loading every pointer.
+// pointers are registered by index, see indexed_atomic_shared_ptr
+class change_index {
+public:
+    explicit change_index(size_t capacity) :
+        versions((capacity + scan_lanes - 1) / scan_lanes * scan_lanes),
+        dirty((capacity + 2 * bits_per_word - 1) / (2 * bits_per_word) * 2) {}
+
+    size_t capacity() const {
+        return versions.size();
+    }
+
+    // called after the pointer at index was published
+    void mark_published(size_t index) {
+        versions[index].fetch_add(1, std::memory_order_release);
+        dirty[index / bits_per_word].fetch_or(uint64_t(1) << (index % bits_per_word), std::memory_order_release);
+    }
+
+    uint32_t version(size_t index) const {
+        return versions[index].load(std::memory_order_acquire);
+    }
+
+    // calls f(index) for every pointer published since the previous sweep and clears its dirty bit.
+    // the bitmap is consumed, so there is one sweeping watcher, others use changed_since()
+    template <typename F>
+    size_t sweep(F f) {
+        size_t changed = 0;
+        for (size_t word = 0; word < dirty.size(); word += 2) {
+            if (!any_set(word)) {
+                continue;
+            }
+            for (size_t half = word; half < word + 2; ++half) {
+                // pairs with fetch_or in mark_published(), a later publish sets the bit again
+                auto bits = dirty[half].exchange(0, std::memory_order_acquire);
+                for (size_t bit = 0; bits; ++bit, bits >>= 1) {
+                    if (bits & 1) {
+                        f(half * bits_per_word + bit);
+                        ++changed;
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+
+    // calls f(index) for every pointer whose version differs from seen and updates seen,
+    // which is the watcher's own copy of the versions, zero initialized with capacity() entries
+    template <typename F>
+    size_t changed_since(std::vector<uint32_t>& seen, F f) const {
+        size_t changed = 0;
+        for (size_t first = 0; first < versions.size(); first += scan_lanes) {
+            auto mask = differing_lanes(seen, first);
+            for (size_t lane = 0; lane < scan_lanes; ++lane) {
+                if (mask & (1u << lane)) {
+                    seen[first + lane] = version(first + lane);
+                    f(first + lane);
+                    ++changed;
+                }
+            }
+        }
+        return changed;
+    }
+
+private:
+    static constexpr size_t bits_per_word = 64;
+    static constexpr size_t scan_lanes = 4;
+
+    // vector loads below read whole aligned lanes, a torn group is only seen as changed a sweep later
+    bool any_set(size_t word) const {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        auto bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dirty[word]));
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(bits, _mm_setzero_si128())) != 0xFFFF;
+#else
+        return dirty[word].load(std::memory_order_relaxed) || dirty[word + 1].load(std::memory_order_relaxed);
+#endif
+    }
+
+    unsigned differing_lanes(const std::vector<uint32_t>& seen, size_t first) const {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        auto current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&versions[first]));
+        auto known = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&seen[first]));
+        return ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(current, known)))) & 0xF;
+#else
+        unsigned mask = 0;
+        for (size_t lane = 0; lane < scan_lanes; ++lane) {
+            if (versions[first + lane].load(std::memory_order_relaxed) != seen[first + lane]) {
+                mask |= 1u << lane;
+            }
+        }
+        return mask;
+#endif
+    }
+
+    std::vector<std::atomic<uint32_t>> versions;
+    std::vector<std::atomic<uint64_t>> dirty;
+};
+
+// records every publish in a change_index under the given index
+template <typename T, typename atomic_shared_ptr = atomic_shared_ptr_with_ring<T>>
+class indexed_atomic_shared_ptr {
+public:
+    // initialization is not atomic and thread safe
+    indexed_atomic_shared_ptr(change_index& index, size_t position, const std::shared_ptr<T>& p) :
+        index(index), position(position), pointer(p) {}
+
+    indexed_atomic_shared_ptr& operator=(const std::shared_ptr<T>& p) {
+        pointer = p;
+        index.mark_published(position);
+        return *this;
+    }
+
+    operator std::shared_ptr<T>() const {
+        return pointer;
+    }
+
+private:
+    change_index& index;
+    const size_t position;
+    atomic_shared_ptr pointer;
+};
+
+// writers publish small deltas on top of a base value instead of whole new values. a version is
+// the base plus the chain of deltas published since, readers apply them to a copy of the base once
+// per version and share the result. a background thread folds the chain into a new base when it
+// reaches compaction_threshold deltas, so readers never replay long chains.
+// delta is anything invocable with T&, full values can still be published with operator=
+template <typename T, typename Delta = std::function<void(T&)>,
+    template <typename> typename atomic_shared_ptr = atomic_shared_ptr_with_ring>
+class delta_chain_atomic_shared_ptr {
+public:
+    // initialization is not atomic and thread safe
+    delta_chain_atomic_shared_ptr(const std::shared_ptr<T>& p, size_t compaction_threshold = 64) :
+        compaction_threshold(compaction_threshold),
+        current(std::make_shared<version>(p, nullptr, 0)),
+        compactor([this] { compact_in_background(); }) {}
+
+    ~delta_chain_atomic_shared_ptr() {
+        {
+            std::lock_guard guard(compaction_mutex);
+            stopping = true;
+        }
+        compaction_needed.notify_one();
+        compactor.join();
+    }
+
+    delta_chain_atomic_shared_ptr& operator=(const std::shared_ptr<T>& p) {
+        std::lock_guard guard(writer_mutex);
+        current = std::make_shared<version>(p, nullptr, 0);
+        return *this;
+    }
+
+    void publish_delta(Delta delta) {
+        size_t length;
+        {
+            std::lock_guard guard(writer_mutex);
+            std::shared_ptr<version> latest = current;
+            length = latest->length + 1;
+            current = std::make_shared<version>(latest->base,
+                std::make_shared<delta_node>(std::move(delta), latest->deltas), length);
+        }
+        if (length == compaction_threshold) {
+            // the compactor is either before its check or waiting
+            std::lock_guard guard(compaction_mutex);
+            compaction_needed.notify_one();
+        }
+    }
+
+    operator std::shared_ptr<T>() const {
+        std::shared_ptr<version> latest = current;
+        return latest->materialize();
+    }
+
+    // number of deltas readers of the current version apply on top of its base
+    size_t chain_length() const {
+        std::shared_ptr<version> latest = current;
+        return latest->length;
+    }
+
+private:
+    struct delta_node {
+        Delta delta;
+        std::shared_ptr<const delta_node> previous;
+
+        delta_node(Delta delta, std::shared_ptr<const delta_node> previous) :
+            delta(std::move(delta)), previous(std::move(previous)) {}
+    };
+
+    struct version {
+        std::shared_ptr<T> base;
+        // newest first
+        std::shared_ptr<const delta_node> deltas;
+        size_t length;
+        // not std::call_once, which deadlocks on throwing deltas with some runtimes
+        mutable std::mutex materialize_mutex;
+        mutable std::atomic_bool is_materialized = { false };
+        mutable std::shared_ptr<T> materialized;
+
+        version(std::shared_ptr<T> base, std::shared_ptr<const delta_node> deltas, size_t length) :
+            base(std::move(base)), deltas(std::move(deltas)), length(length) {}
+
+        std::shared_ptr<T> materialize() const {
+            if (!deltas) {
+                return base;
+            }
+            if (is_materialized.load(std::memory_order_acquire)) {
+                return materialized;
+            }
+            std::lock_guard guard(materialize_mutex);
+            if (!is_materialized.load(std::memory_order_relaxed)) {
+                std::vector<const Delta*> chain;
+                chain.reserve(length);
+                for (auto node = deltas.get(); node; node = node->previous.get()) {
+                    chain.push_back(&node->delta);
+                }
+                auto value = std::make_shared<T>(*base);
+                for (auto delta = chain.rbegin(); delta != chain.rend(); ++delta) {
+                    std::invoke(**delta, *value);
+                }
+                materialized = std::move(value);
+                is_materialized.store(true, std::memory_order_release);
+            }
+            return materialized;
+        }
+    };
+
+    void compact_in_background() {
+        std::unique_lock lock(compaction_mutex);
+        // the version whose deltas threw, retrying it would throw again
+        std::shared_ptr<version> failed;
+        for (;;) {
+            compaction_needed.wait(lock, [this, &failed] {
+                if (stopping) {
+                    return true;
+                }
+                std::shared_ptr<version> latest = current;
+                return latest->length >= compaction_threshold && latest != failed;
+            });
+            if (stopping) {
+                return;
+            }
+            lock.unlock();
+            failed = compact();
+            lock.lock();
+        }
+    }
+
+    // builds the new base without blocking writers, then moves the deltas published meanwhile on top of it.
+    // when a delta throws the chain is left as it is, so readers replaying it get the exception.
+    // returns the version which failed to compact
+    std::shared_ptr<version> compact() {
+        std::shared_ptr<version> folded = current;
+        try {
+            auto base = folded->materialize();
+            INJECTION_POINT();
+
+            std::lock_guard guard(writer_mutex);
+            std::shared_ptr<version> latest = current;
+            if (latest->base != folded->base) {
+                // a full value was published meanwhile
+                return {};
+            }
+            std::vector<const delta_node*> newer;
+            for (auto node = latest->deltas.get(); node != folded->deltas.get(); node = node->previous.get()) {
+                if (!node) {
+                    // a full value was published meanwhile
+                    return {};
+                }
+                newer.push_back(node);
+            }
+            std::shared_ptr<const delta_node> deltas;
+            for (auto node = newer.rbegin(); node != newer.rend(); ++node) {
+                deltas = std::make_shared<delta_node>((*node)->delta, std::move(deltas));
+            }
+            current = std::make_shared<version>(base, std::move(deltas), newer.size());
+        } catch (...) {
+            return folded;
+        }
+        return {};
+    }
+
+    const size_t compaction_threshold;
+    atomic_shared_ptr<version> current;
+    std::mutex writer_mutex;
+    std::mutex compaction_mutex;
+    std::condition_variable compaction_needed;
+    bool stopping = false;
+    std::thread compactor;
+};
+
+// publish_lazy() publishes a factory instead of a value, the first reader of it builds the value
+// and readers coming meanwhile wait for that single construction. values superseded before
+// anybody read them are never built. when the factory throws, the reader gets the exception
+// and the next reader tries again
+template <typename T, template <typename> typename atomic_shared_ptr = atomic_shared_ptr_with_ring>
+class lazy_atomic_shared_ptr {
+public:
+    using factory = std::function<std::shared_ptr<T>()>;
+
+    // initialization is not atomic and thread safe
+    lazy_atomic_shared_ptr(const std::shared_ptr<T>& p) : current(std::make_shared<lazy_value>(p)) {}
+
+    lazy_atomic_shared_ptr& operator=(const std::shared_ptr<T>& p) {
+        current = std::make_shared<lazy_value>(p);
+        return *this;
+    }
+
+    void publish_lazy(factory make) {
+        current = std::make_shared<lazy_value>(std::move(make));
+    }
+
+    operator std::shared_ptr<T>() const {
+        std::shared_ptr<lazy_value> latest = current;
+        return latest->get();
+    }
+
+private:
+    struct lazy_value {
+        factory make;
+        // not std::call_once, which deadlocks on throwing factories with some runtimes
+        std::mutex build_mutex;
+        std::atomic_bool built;
+        std::shared_ptr<T> value;
+
+        explicit lazy_value(std::shared_ptr<T> value) : built(true), value(std::move(value)) {}
+        explicit lazy_value(factory make) : make(std::move(make)), built(false) {}
+
+        std::shared_ptr<T> get() {
+            if (!built.load(std::memory_order_acquire)) {
+                INJECTION_POINT();
+                std::lock_guard guard(build_mutex);
+                if (!built.load(std::memory_order_relaxed)) {
+                    value = make();
+                    INJECTION_POINT();
+                    // drop whatever the factory captured
+                    make = nullptr;
+                    built.store(true, std::memory_order_release);
+                }
+            }
+            return value;
+        }
+    };
+
+    atomic_shared_ptr<lazy_value> current;
+};
+
+// index plus generation of a handle_table entry, fits in 64 bits. a default handle is never valid
+template <typename T>
+struct handle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+};
+
+// slot map of trivially copyable values, addressed by handles. a handle stays valid while its entry
+// is republished and turns stale once the entry is erased, which is one generation compare.
+// values are copied out under a per-slot sequence instead of reference counting, so lookups
+// don't touch any shared control block. inserts and erases are serialized, lookups and publishes aren't
+template <typename T>
+class handle_table {
+    static_assert(std::is_trivially_copyable_v<T>, "values are copied word by word");
+
+public:
+    explicit handle_table(size_t capacity) : slots(capacity) {
+        for (size_t idx = capacity; idx > 0; --idx) {
+            free_slots.push_back(static_cast<uint32_t>(idx - 1));
+        }
+    }
+
+    handle<T> insert(const T& value) {
+        std::lock_guard guard(free_mutex);
+        if (free_slots.empty()) {
+            throw std::length_error("handle table is full");
+        }
+        auto idx = free_slots.back();
+        free_slots.pop_back();
+        auto generation = generation_of(slots[idx].sequence.load(std::memory_order_relaxed));
+        publish({ idx, generation }, value);
+        return { idx, generation };
+    }
+
+    // returns false when the handle is stale or not from this table
+    bool erase(handle<T> h) {
+        if (h.index >= slots.size()) {
+            return false;
+        }
+        auto& entry = slots[h.index];
+        uint64_t sequence;
+        if (!lock_slot(entry, h, sequence)) {
+            return false;
+        }
+        // generation 0 is left to default handles
+        uint32_t generation = h.generation + 1 ? h.generation + 1 : 1;
+        entry.sequence.store(uint64_t(generation) << 32, std::memory_order_release);
+        std::lock_guard guard(free_mutex);
+        free_slots.push_back(h.index);
+        return true;
+    }
+
+    // replaces the value, the handle stays valid. returns false when the handle is stale or not from this table
+    bool publish(handle<T> h, const T& value) {
+        if (h.index >= slots.size()) {
+            return false;
+        }
+        auto& entry = slots[h.index];
+        uint64_t sequence;
+        if (!lock_slot(entry, h, sequence)) {
+            return false;
+        }
+        uint64_t words[word_count] = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t word = 0; word < word_count; ++word) {
+            entry.words[word].store(words[word], std::memory_order_relaxed);
+            INJECTION_POINT();
+        }
+        entry.sequence.store(next_write(sequence), std::memory_order_release);
+        return true;
+    }
+
+    // copies the value to out, returns false when the handle is stale or not from this table
+    bool load(handle<T> h, T& out) const {
+        if (h.index >= slots.size()) {
+            return false;
+        }
+        auto& entry = slots[h.index];
+        for (;;) {
+            auto sequence = entry.sequence.load(std::memory_order_acquire);
+            if (generation_of(sequence) != h.generation) {
+                return false;
+            }
+            if (sequence & writing_bit) {
+                cpu_relax();
+                continue;
+            }
+            uint64_t words[word_count];
+            for (size_t word = 0; word < word_count; ++word) {
+                words[word] = entry.words[word].load(std::memory_order_relaxed);
+                INJECTION_POINT();
+            }
+            // order the copy before the check, a write meanwhile changes the sequence
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.sequence.load(std::memory_order_relaxed) == sequence) {
+                std::memcpy(&out, words, sizeof(T));
+                return true;
+            }
+        }
+    }
+
+    bool valid(handle<T> h) const {
+        return h.index < slots.size() &&
+            generation_of(slots[h.index].sequence.load(std::memory_order_acquire)) == h.generation;
+    }
+
+private:
+    static constexpr size_t word_count = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    static constexpr uint64_t writing_bit = 1;
+
+    // generation in the upper half, write count with the writing flag in its lowest bit in the lower half
+    struct alignas(cache_line_size) slot {
+        std::atomic<uint64_t> sequence = { uint64_t(1) << 32 };
+        std::array<std::atomic<uint64_t>, word_count> words = {};
+    };
+
+    static uint32_t generation_of(uint64_t sequence) {
+        return static_cast<uint32_t>(sequence >> 32);
+    }
+
+    // ends a write, the write count wraps without touching the generation
+    static uint64_t next_write(uint64_t sequence) {
+        return (sequence & ~uint64_t(0xFFFFFFFF)) | ((sequence + 2) & uint64_t(0xFFFFFFFE));
+    }
+
+    static bool lock_slot(slot& entry, handle<T> h, uint64_t& sequence) {
+        for (;;) {
+            sequence = entry.sequence.load(std::memory_order_relaxed);
+            if (generation_of(sequence) != h.generation) {
+                return false;
+            }
+            if (!(sequence & writing_bit) && !INJECTED_FAILURE() &&
+                entry.sequence.compare_exchange_weak(sequence, sequence | writing_bit, std::memory_order_acquire)) {
+                // readers must see the writing flag before any of the new words
+                std::atomic_thread_fence(std::memory_order_release);
+                return true;
+            }
+            cpu_relax();
+        }
+    }
+
+    std::vector<slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::mutex free_mutex;
+};
+
+// nodes holding a trivially copyable T, recycled but never given back to the system. any node
+// pointer ever seen stays readable, so readers may copy a node which was meanwhile recycled and
+// find out afterwards from its version
+template <typename T>
+class type_stable_pool {
+    static_assert(std::is_trivially_copyable_v<T>, "values are copied word by word");
+
+    static constexpr size_t word_count = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    static constexpr size_t chunk_size = 64;
+
+public:
+    struct alignas(cache_line_size) node {
+        // odd while the node is being filled
+        std::atomic<uint64_t> version = { 0 };
+        std::array<std::atomic<uint64_t>, word_count> words = {};
+        node* next_free = nullptr;
+    };
+
+    static node* allocate(const T& value) {
+        auto allocated = pop_free();
+        allocated->version.fetch_add(1, std::memory_order_relaxed);
+        // readers must see the odd version before any of the new words
+        std::atomic_thread_fence(std::memory_order_release);
+        uint64_t words[word_count] = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t word = 0; word < word_count; ++word) {
+            allocated->words[word].store(words[word], std::memory_order_relaxed);
+            INJECTION_POINT();
+        }
+        allocated->version.fetch_add(1, std::memory_order_release);
+        return allocated;
+    }
+
+    // the node may still be read optimistically, so it goes back to the free list only
+    static void release(node* released) {
+        auto& pool = shared();
+        std::lock_guard guard(pool.mutex);
+        released->next_free = pool.free;
+        pool.free = released;
+    }
+
+    // copies the value of the node to out, fails when the node was refilled meanwhile.
+    // version is the fill the copy comes from, see unchanged()
+    static bool read(const node* source, T& out, uint64_t& version) {
+        version = source->version.load(std::memory_order_acquire);
+        if (version & 1) {
+            return false;
+        }
+        uint64_t words[word_count];
+        for (size_t word = 0; word < word_count; ++word) {
+            words[word] = source->words[word].load(std::memory_order_relaxed);
+            INJECTION_POINT();
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (source->version.load(std::memory_order_relaxed) != version) {
+            return false;
+        }
+        std::memcpy(&out, words, sizeof(T));
+        return true;
+    }
+
+    // true if the node was not refilled since the fill of the given version
+    static bool unchanged(const node* source, uint64_t version) {
+        return source->version.load(std::memory_order_acquire) == version;
+    }
+
+private:
+    struct state {
+        std::mutex mutex;
+        node* free = nullptr;
+        std::vector<std::unique_ptr<node[]>> chunks;
+    };
+
+    // never destroyed, readers on other threads may outlive static destruction
+    static state& shared() {
+        static state* pool = new state();
+        return *pool;
+    }
+
+    static node* pop_free() {
+        auto& pool = shared();
+        std::lock_guard guard(pool.mutex);
+        if (!pool.free) {
+            pool.chunks.push_back(std::make_unique<node[]>(chunk_size));
+            for (size_t idx = 0; idx < chunk_size; ++idx) {
+                pool.chunks.back()[idx].next_free = pool.free;
+                pool.free = &pool.chunks.back()[idx];
+            }
+        }
+        return std::exchange(pool.free, pool.free->next_free);
+    }
+};
+
+// value of a trivially copyable T in type stable nodes. readers copy the current node and validate
+// its version afterwards, without any hazard pointer or reference count; a failed validation means
+// a newer value was published, so they just start over. the pool is shared by all instances of T,
+// so a copy may come from a fill by another instance. readers check that the node is current
+// and then that its version is still the copied one, the node was ours for the whole copy then.
+// load() is the cheap path, the shared_ptr conversion copies the value into a new allocation
+template <typename T>
+class atomic_shared_ptr_with_type_stable_pool {
+    using pool = type_stable_pool<T>;
+
+public:
+    // initialization is not atomic and thread safe
+    atomic_shared_ptr_with_type_stable_pool(const std::shared_ptr<T>& p) : current(pool::allocate(*p)) {}
+
+    ~atomic_shared_ptr_with_type_stable_pool() {
+        pool::release(current.load(std::memory_order_relaxed));
+    }
+
+    atomic_shared_ptr_with_type_stable_pool(const atomic_shared_ptr_with_type_stable_pool&) = delete;
+    atomic_shared_ptr_with_type_stable_pool& operator=(const atomic_shared_ptr_with_type_stable_pool&) = delete;
+
+    atomic_shared_ptr_with_type_stable_pool& operator=(const std::shared_ptr<T>& p) {
+        store(*p);
+        return *this;
+    }
+
+    void store(const T& value) {
+        INJECTION_POINT();
+        pool::release(current.exchange(pool::allocate(value), std::memory_order_acq_rel));
+    }
+
+    T load() const {
+        T result;
+        for (;;) {
+            auto source = current.load(std::memory_order_acquire);
+            uint64_t version = 0;
+            // current alone passes when the node went back to the pool and we refilled it after
+            // the copy, the refill happens before its publish, so the version shows it then
+            if (pool::read(source, result, version) && current.load(std::memory_order_acquire) == source &&
+                pool::unchanged(source, version)) {
+                return result;
+            }
+        }
+    }
+
+    operator std::shared_ptr<T>() const {
+        return std::make_shared<T>(load());
+    }
+
+private:
+    std::atomic<typename pool::node*> current;
+};
+
+const size_t reader_count = 4;
+const size_t writer_count = 2;
+const size_t iterations = 1000000;
+const auto writers_interval = std::chrono::nanoseconds(1);
+// spread test threads over numa nodes round-robin, set by --pin-numa-nodes
+bool pin_to_numa_nodes = false;
+
+void pin_test_thread(size_t thread_index) {
+    if (pin_to_numa_nodes) {
+        pin_current_thread_to_numa_node(thread_index % numa_node_count());
+    }
+}
+
+// thread driver of the benchmarks: starts background(index, enabled) threads, then timed(index) ones,
+// and keeps the background ones running until all timed ones are done. returns the time the timed
+// threads took. threads are pinned by index counted from their first_pin
+template <typename Timed, typename Background>
+std::chrono::nanoseconds time_threads(size_t timed_count, size_t timed_first_pin,
+    size_t background_count, size_t background_first_pin, Timed timed, Background background) {
+    std::vector<std::thread> timed_tasks(timed_count);
+    std::vector<std::thread> background_tasks(background_count);
+
+    std::atomic_bool enabled = true;
+    for (size_t index = 0; index < background_count; ++index) {
+        background_tasks[index] = std::thread([&background, &enabled, index, background_first_pin]() {
+            pin_test_thread(background_first_pin + index);
+            background(index, enabled);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t index = 0; index < timed_count; ++index) {
+        timed_tasks[index] = std::thread([&timed, index, timed_first_pin]() {
+            pin_test_thread(timed_first_pin + index);
+            timed(index);
+        });
+    }
+    for (auto& task : timed_tasks) {
+        task.join();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    enabled = false;
+    for (auto& task : background_tasks) {
+        task.join();
+    }
+    return end - start;
+}
+
+// readers run read(reader) to completion while writers run write(writer, enabled)
+template <typename Read, typename Write>
+std::chrono::nanoseconds time_readers(size_t reader_threads, size_t writer_threads, Read read, Write write) {
+    return time_threads(reader_threads, 0, writer_threads, reader_threads, read, write);
+}
+
+// writers run write(writer) to completion while readers run read(reader, enabled)
+template <typename Read, typename Write>
+std::chrono::nanoseconds time_writers(size_t reader_threads, size_t writer_threads, Read read, Write write) {
+    return time_threads(writer_threads, reader_threads, reader_threads, 0, write, read);
+}
+
+// reads done by a reader thread of the churn test before it exits and is replaced
+const size_t churn_reads_per_thread = 1000;
+
+// values published by the churn test which are not destroyed yet
+std::atomic<size_t> churn_live_values = 0;
+std::atomic<size_t> churn_peak_live_values = 0;
+
+std::shared_ptr<size_t> make_churn_value(size_t value) {
+    auto live = churn_live_values.fetch_add(1) + 1;
+    auto peak = churn_peak_live_values.load();
+    while (peak < live && !churn_peak_live_values.compare_exchange_weak(peak, live)) {
+    }
+    return std::shared_ptr<size_t>(new size_t(value), [](size_t* p) {
+        churn_live_values.fetch_sub(1);
+        delete p;
+    });
+}
+
+template <typename P, typename = void>
+struct has_registry_size : std::false_type {};
+
+template <typename P>
+struct has_registry_size<P, std::void_t<decltype(std::declval<const P&>().registry_size())>> : std::true_type {};
+
+// like run_test, but reader threads exit after churn_reads_per_thread reads and new ones take their
+// place, as in elastic thread pools. writers publish fresh values, so values kept alive by retired
+// per-thread state show up in the live values count
+template<template<typename> typename atomic_shared_ptr, size_t reader_threads = reader_count, size_t writer_threads = writer_count>
+void run_churn_test() {
+    churn_peak_live_values = churn_live_values.load();
+    auto live_before = churn_live_values.load();
+    {
+        atomic_shared_ptr<size_t> shared_ptr = make_churn_value(0);
+
+        auto elapsed = time_readers(reader_threads, writer_threads,
+            [&shared_ptr](size_t reader) {
+                for (size_t done = 0; done < iterations; done += churn_reads_per_thread) {
+                    std::thread([&shared_ptr, reader]() {
+                        pin_test_thread(reader);
+                        size_t sum = 0;
+                        for (size_t i = 0; i < churn_reads_per_thread; ++i) {
+                            std::shared_ptr<size_t> local_ptr = shared_ptr;
+                            sum += *local_ptr;
+                        }
+                        static_cast<void>(sum);
+                    }).join();
+                }
+            },
+            [&shared_ptr](size_t writer, const std::atomic_bool& enabled) {
+                while (enabled) {
+                    std::this_thread::sleep_for(writers_interval);
+                    shared_ptr = make_churn_value(writer + 1);
+                }
+            });
+
+        std::cout << iterations << " done in " <<
+            std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms by " <<
+            reader_threads * ((iterations + churn_reads_per_thread - 1) / churn_reads_per_thread) << " readers, " <<
+            churn_live_values - live_before << " values live (peak " << churn_peak_live_values - live_before << ")";
+        if constexpr (has_registry_size<atomic_shared_ptr<size_t>>::value) {
+            std::cout << ", registry size " << shared_ptr.registry_size();
+        }
+        std::cout << "\n";
+    }
+    // values still alive here are held by per-thread state which outlived its threads
+    if (churn_live_values != live_before) {
+        std::cout << churn_live_values - live_before << " values leaked\n";
+    }
+}
+
+template<template<typename> typename atomic_shared_ptr, size_t reader_threads = reader_count, size_t writer_threads = writer_count>
+void run_test() {
+    atomic_shared_ptr<size_t> shared_ptr = std::make_shared<size_t>(0);
+
+    size_t sums[reader_threads][writer_threads + 1] = { 0 };
+
+    auto elapsed = time_readers(reader_threads, writer_threads,
+        [&shared_ptr, &sums](size_t reader) {
+            for (size_t i = 0; i < iterations; ++i) {
+                std::shared_ptr<size_t> local_ptr = shared_ptr;
+                sums[reader][*local_ptr]++;
+            }
+        },
+        [&shared_ptr](size_t writer, const std::atomic_bool& enabled) {
+            auto local = std::make_shared<size_t>(writer + 1);
+            while (enabled) {
+                std::this_thread::sleep_for(writers_interval);
+                shared_ptr = local;
+            }
+        });
+
+    std::cout << iterations << " done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms\n";
+
+    //for (size_t reader = 0; reader < reader_count; ++reader) {
+    //    std::cout << "Reader " << reader << " :";
+    //    for (size_t writer = 0; writer <= writer_count; ++writer) {
+    //        std::cout << " " << 100.0 * sums[reader][writer] / iterations << "% (" << sums[reader][writer] << ")";
+    //    }
+    //    std::cout << "\n";
+    //}
+}
+
+// like run_test, but measures writers: every writer publishes publish_iterations values
+// while readers keep reading, which matters for wide rings written by many threads
+const size_t publish_iterations = iterations / 10;
+
+template<template<typename> typename atomic_shared_ptr, size_t reader_threads = reader_count, size_t writer_threads = writer_count>
+void run_publish_test() {
+    atomic_shared_ptr<size_t> shared_ptr = std::make_shared<size_t>(0);
+
+    auto elapsed = time_writers(reader_threads, writer_threads,
+        [&shared_ptr](size_t, const std::atomic_bool& enabled) {
+            size_t sum = 0;
+            while (enabled) {
+                std::shared_ptr<size_t> local_ptr = shared_ptr;
+                sum += *local_ptr;
+            }
+            static_cast<void>(sum);
+        },
+        [&shared_ptr](size_t writer) {
+            auto local = std::make_shared<size_t>(writer + 1);
+            for (size_t i = 0; i < publish_iterations; ++i) {
+                shared_ptr = local;
+            }
+        });
+
+    std::cout << publish_iterations << " publishes done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms\n";
+}
+
+// publishing of large values by several writers, either freshly allocated or refilled from
+// acquire_recycled(). readers check that no value is refilled while they still hold it
+const size_t recycle_value_size = 1 << 20;
+const size_t recycle_publishes = 1000;
+
+template <bool recycled, bool eager_release>
+void run_recycle_test() {
+    using value = std::vector<unsigned char>;
+    atomic_shared_ptr_with_ring<value> shared_ptr = std::make_shared<value>(recycle_value_size, 0);
+    shared_ptr.set_eager_release(eager_release);
+
+    std::atomic<size_t> torn = 0;
+    std::atomic<size_t> reused = 0;
+    auto elapsed = time_writers(reader_count, writer_count,
+        [&shared_ptr, &torn](size_t, const std::atomic_bool& enabled) {
+            while (enabled) {
+                std::shared_ptr<value> local_ptr = shared_ptr;
+                if (local_ptr->front() != local_ptr->back()) {
+                    torn.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        },
+        [&shared_ptr, &reused](size_t writer) {
+            for (size_t i = 0; i < recycle_publishes; ++i) {
+                auto fill = static_cast<unsigned char>(writer * recycle_publishes + i);
+                std::shared_ptr<value> local;
+                if constexpr (recycled) {
+                    local = shared_ptr.acquire_recycled();
+                }
+                if (local) {
+                    reused.fetch_add(1, std::memory_order_relaxed);
+                    std::fill(local->begin(), local->end(), fill);
+                } else {
+                    local = std::make_shared<value>(recycle_value_size, fill);
+                }
+                shared_ptr = local;
+            }
+        });
+
+    std::cout << recycle_publishes << " publishes done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, " <<
+        reused << " recycled, " << shared_ptr.retained_count() << " values retained (" <<
+        shared_ptr.retained_bytes([](const value& v) { return v.capacity(); }) << " bytes)";
+    if (torn != 0) {
+        std::cout << ", " << torn << " values refilled while read";
+    }
+    std::cout << "\n";
+}
+
+template <typename T>
+using atomic_shared_ptr_with_ring_16 = atomic_shared_ptr_with_ring<T, 16>;
+template <typename T>
+using atomic_shared_ptr_with_ring_64 = atomic_shared_ptr_with_ring<T, 64>;
+template <typename T>
+using atomic_shared_ptr_with_ring_256 = atomic_shared_ptr_with_ring<T, 256>;
+
+// a request loads load_many_batch pointers picked at random from a pool much larger than the cache
+const size_t load_many_pool = 1 << 16;
+const size_t load_many_batch = 128;
+
+template <bool bulk>
+void run_load_many_test() {
+    std::vector<std::unique_ptr<atomic_shared_ptr_with_ring<size_t>>> pool;
+    for (size_t i = 0; i < load_many_pool; ++i) {
+        pool.push_back(std::make_unique<atomic_shared_ptr_with_ring<size_t>>(std::make_shared<size_t>(i)));
+    }
+    std::vector<const atomic_shared_ptr_with_ring<size_t>*> batch(load_many_batch);
+    std::vector<std::shared_ptr<size_t>> loaded(load_many_batch);
+    size_t requests = iterations / load_many_batch;
+    uint64_t random = 88172645463325252ull;
+    std::chrono::nanoseconds elapsed(0);
+
+    for (size_t request = 0; request < requests; ++request) {
+        for (auto& source : batch) {
+            // xorshift, cheap enough to not hide the loads
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            source = pool[random % load_many_pool].get();
+        }
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (bulk) {
+            load_many(batch.data(), batch.size(), loaded.data());
+        } else {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                loaded[i] = *batch[i];
+            }
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    std::cout << requests << " requests of " << load_many_batch << " loads done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms\n";
+}
+
+// a watcher looks for pointers changed since its previous sweep among change_watch_pool ones,
+// change_watch_publishes of them are published between sweeps
+const size_t change_watch_pool = 4096;
+const size_t change_watch_publishes = 16;
+
+template <bool indexed>
+void run_change_watch_test() {
+    change_index index(change_watch_pool);
+    std::vector<std::unique_ptr<indexed_atomic_shared_ptr<size_t>>> pool;
+    std::vector<const size_t*> seen_values;
+    std::vector<uint32_t> seen_versions(index.capacity());
+    for (size_t i = 0; i < change_watch_pool; ++i) {
+        auto value = std::make_shared<size_t>(i);
+        pool.push_back(std::make_unique<indexed_atomic_shared_ptr<size_t>>(index, i, value));
+        seen_values.push_back(value.get());
+    }
+    auto value = std::make_shared<size_t>(0);
+    size_t sweeps = iterations / change_watch_pool;
+    size_t found = 0;
+    uint64_t random = 88172645463325252ull;
+    std::chrono::nanoseconds elapsed(0);
+
+    for (size_t sweep = 0; sweep < sweeps; ++sweep) {
+        for (size_t i = 0; i < change_watch_publishes; ++i) {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            *pool[random % change_watch_pool] = std::make_shared<size_t>(sweep);
+        }
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (indexed) {
+            found += index.changed_since(seen_versions, [](size_t) {});
+        } else {
+            for (size_t i = 0; i < change_watch_pool; ++i) {
+                std::shared_ptr<size_t> current = *pool[i];
+                if (current.get() != seen_values[i]) {
+                    seen_values[i] = current.get();
+                    ++found;
+                }
+            }
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    std::cout << sweeps << " sweeps over " << change_watch_pool << " pointers found " << found <<
+        " changes in " << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " us\n";
+}
+
+// writers publish every pointer of their share once, interleaved so they set bits of the same words,
+// while a watcher keeps sweeping. every published pointer must be reported by exactly one sweep
+void check_change_index_sweep() {
+    change_index index(change_watch_pool);
+    std::vector<std::unique_ptr<indexed_atomic_shared_ptr<size_t>>> pool;
+    for (size_t i = 0; i < change_watch_pool; ++i) {
+        pool.push_back(std::make_unique<indexed_atomic_shared_ptr<size_t>>(index, i, std::make_shared<size_t>(i)));
+    }
+    std::vector<size_t> reported(change_watch_pool);
+    size_t sweeps = 0;
+
+    time_writers(1, writer_count,
+        [&index, &reported, &sweeps](size_t, const std::atomic_bool& enabled) {
+            while (enabled) {
+                index.sweep([&reported](size_t i) { ++reported[i]; });
+                ++sweeps;
+            }
+        },
+        [&pool](size_t writer) {
+            for (size_t i = writer; i < change_watch_pool; i += writer_count) {
+                *pool[i] = std::make_shared<size_t>(i + 1);
+            }
+        });
+    // whatever was published after the watcher's last sweep
+    index.sweep([&reported](size_t i) { ++reported[i]; });
+
+    auto missed = std::count(reported.begin(), reported.end(), 0);
+    auto repeated = std::count_if(reported.begin(), reported.end(), [](size_t count) { return count > 1; });
+    std::cout << sweeps + 1 << " sweeps over " << change_watch_pool << " published pointers, " <<
+        missed << " missed, " << repeated << " reported more than once\n";
+}
+
+// like run_test, but readers look the value up by handle and writers republish it
+template<size_t reader_threads = reader_count, size_t writer_threads = writer_count>
+void run_handle_test() {
+    handle_table<size_t> table(1);
+    auto value = table.insert(0);
+
+    size_t sums[reader_threads][writer_threads + 1] = { 0 };
+
+    auto elapsed = time_readers(reader_threads, writer_threads,
+        [&table, &sums, value](size_t reader) {
+            for (size_t i = 0; i < iterations; ++i) {
+                size_t local = 0;
+                table.load(value, local);
+                sums[reader][local]++;
+            }
+        },
+        [&table, value](size_t writer, const std::atomic_bool& enabled) {
+            while (enabled) {
+                std::this_thread::sleep_for(writers_interval);
+                table.publish(value, writer + 1);
+            }
+        });
+
+    std::cout << iterations << " done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms\n";
+}
+
+// like run_test, but readers copy the value with load() instead of converting to shared_ptr
+template<size_t reader_threads = reader_count, size_t writer_threads = writer_count>
+void run_type_stable_pool_test() {
+    atomic_shared_ptr_with_type_stable_pool<size_t> value = std::make_shared<size_t>(0);
+
+    size_t sums[reader_threads][writer_threads + 1] = { 0 };
+
+    auto elapsed = time_readers(reader_threads, writer_threads,
+        [&value, &sums](size_t reader) {
+            for (size_t i = 0; i < iterations; ++i) {
+                sums[reader][value.load()]++;
+            }
+        },
+        [&value](size_t writer, const std::atomic_bool& enabled) {
+            while (enabled) {
+                std::this_thread::sleep_for(writers_interval);
+                value.store(writer + 1);
+            }
+        });
+
+    std::cout << iterations << " done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms\n";
+}
+
+// a writer updates single keys of a table of delta_table_size entries while readers keep reading it,
+// either publishing a whole updated copy each time or just the delta
+const size_t delta_table_size = 4096;
+const size_t delta_updates = publish_iterations / 10;
+
+template <bool deltas>
+void run_delta_test() {
+    using table = std::vector<size_t>;
+    auto initial = std::make_shared<table>(delta_table_size);
+    atomic_shared_ptr_with_ring<table> full(initial);
+    delta_chain_atomic_shared_ptr<table> chain(initial);
+
+    std::vector<std::thread> readers(reader_count);
+    std::atomic_bool enable_readers = true;
+    // readers materialize the versions, so their reads are where the deltas are paid for
+    std::atomic<size_t> reads = 0;
+    std::atomic<size_t> started = 0;
+    for (size_t reader = 0; reader < reader_count; ++reader) {
+        readers[reader] = std::thread([&full, &chain, &enable_readers, &reads, &started, reader]() {
+            pin_test_thread(reader);
+            size_t sum = 0;
+            size_t done = 0;
+            for (; enable_readers; ++done) {
+                std::shared_ptr<table> local_ptr;
+                if constexpr (deltas) {
+                    local_ptr = chain;
+                } else {
+                    local_ptr = full;
+                }
+                sum += (*local_ptr)[reader];
+                if (done == 0) {
+                    started.fetch_add(1);
+                }
+            }
+            static_cast<void>(sum);
+            reads.fetch_add(done, std::memory_order_relaxed);
+        });
+    }
+
+    while (started != reader_count) {
+        std::this_thread::yield();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t update = 0; update < delta_updates; ++update) {
+        auto key = update % delta_table_size;
+        if constexpr (deltas) {
+            chain.publish_delta([key, update](table& value) { value[key] = update; });
+        } else {
+            std::shared_ptr<table> latest = full;
+            auto updated = std::make_shared<table>(*latest);
+            (*updated)[key] = update;
+            full = updated;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    enable_readers = false;
+    for (auto& task : readers) {
+        task.join();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    std::cout << delta_updates << " updates done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, " << reads << " reads meanwhile";
+    if (reads != 0) {
+        std::cout << " (" << elapsed.count() * reader_count / reads << " ns per read)";
+    }
+    std::cout << "\n";
+}
+
+// a writer publishes tables of delta_table_size entries every lazy_publish_interval while readers keep
+// reading. lazily published tables are built by the first reader getting to them, others wait for it,
+// so reads are timed as well: their average and the longest one, which includes building or waiting.
+// with sparse_reads the writer publishes back to back and readers read every lazy_publish_interval
+// instead, so most lazily published tables are replaced before anyone reads them and never built
+const auto lazy_publish_interval = std::chrono::microseconds(100);
+const size_t lazy_publishes = delta_updates / 10;
+
+template <bool lazy, bool sparse_reads = false>
+void run_lazy_test() {
+    using table = std::vector<size_t>;
+    lazy_atomic_shared_ptr<table> shared_ptr = std::make_shared<table>(delta_table_size);
+    std::atomic<size_t> built = 0;
+
+    std::mutex stats_mutex;
+    size_t reads = 0;
+    std::chrono::nanoseconds read_time(0);
+    std::chrono::nanoseconds longest_read(0);
+
+    auto elapsed = time_writers(reader_count, 1,
+        [&shared_ptr, &stats_mutex, &reads, &read_time, &longest_read](size_t reader, const std::atomic_bool& enabled) {
+            size_t sum = 0;
+            size_t done = 0;
+            std::chrono::nanoseconds spent(0);
+            std::chrono::nanoseconds longest(0);
+            for (; enabled; ++done) {
+                if constexpr (sparse_reads) {
+                    std::this_thread::sleep_for(lazy_publish_interval);
+                }
+                auto start = std::chrono::steady_clock::now();
+                std::shared_ptr<table> local_ptr = shared_ptr;
+                auto took = std::chrono::steady_clock::now() - start;
+                spent += took;
+                longest = std::max<std::chrono::nanoseconds>(longest, took);
+                sum += (*local_ptr)[reader];
+            }
+            static_cast<void>(sum);
+            std::lock_guard guard(stats_mutex);
+            reads += done;
+            read_time += spent;
+            longest_read = std::max(longest_read, longest);
+        },
+        [&shared_ptr, &built](size_t) {
+            for (size_t update = 0; update < lazy_publishes; ++update) {
+                if constexpr (!sparse_reads) {
+                    std::this_thread::sleep_for(lazy_publish_interval);
+                }
+                auto make = [&built, update]() {
+                    built.fetch_add(1, std::memory_order_relaxed);
+                    return std::make_shared<table>(delta_table_size, update);
+                };
+                if constexpr (lazy) {
+                    shared_ptr.publish_lazy(make);
+                } else {
+                    shared_ptr = make();
+                }
+            }
+        });
+
+    std::cout << lazy_publishes << " publishes done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms, " <<
+        built << " values built, " << reads << " reads";
+    if (reads != 0) {
+        std::cout << " taking " << read_time.count() / reads << " ns on average and " <<
+            std::chrono::duration_cast<std::chrono::microseconds>(longest_read).count() << " us at most";
+    }
+    std::cout << "\n";
+}
+
+// a restarted instance maps the value saved by the previous one instead of rebuilding it.
+// compares startup from scratch and from the snapshot and checks the saved value survived
+const size_t persistent_table_size = 1 << 17;
+
+void run_persistent_test() {
+    struct table {
+        size_t values[persistent_table_size];
+    };
+    auto build = [](size_t seed) {
+        auto value = std::make_shared<table>();
+        for (size_t i = 0; i < persistent_table_size; ++i) {
+            value->values[i] = seed * i;
+        }
+        return value;
+    };
+    const std::string path = "AtomicSharedPtr.snapshot." + std::to_string(current_process_id());
+    std::remove(path.c_str());
+
+    auto cold_start = std::chrono::steady_clock::now();
+    persistent_atomic_shared_ptr<table> first(path, build(1));
+    auto cold_end = std::chrono::steady_clock::now();
+    first = build(2);
+
+    auto warm_start = std::chrono::steady_clock::now();
+    persistent_atomic_shared_ptr<table> second(path, nullptr);
+    auto warm_end = std::chrono::steady_clock::now();
+
+    std::shared_ptr<table> loaded = second;
+    size_t mismatched = 0;
+    for (size_t i = 0; loaded && i < persistent_table_size; ++i) {
+        mismatched += loaded->values[i] != 2 * i;
+    }
+    std::remove(path.c_str());
+
+    std::cout << "started in " << std::chrono::duration_cast<std::chrono::microseconds>(cold_end - cold_start).count() <<
+        " us from scratch, " << std::chrono::duration_cast<std::chrono::microseconds>(warm_end - warm_start).count() <<
+        " us from snapshot, ";
+    if (!loaded) {
+        std::cout << "snapshot not found\n";
+    } else {
+        std::cout << mismatched << " values differ after restart\n";
+    }
+}
+
+// two instances share the pool of their type, readers of the first one must never see
+// a value which only the second one published into a recycled node
+void check_type_stable_pool_instances() {
+    atomic_shared_ptr_with_type_stable_pool<size_t> first = std::make_shared<size_t>(1);
+    atomic_shared_ptr_with_type_stable_pool<size_t> second = std::make_shared<size_t>(2);
+
+    std::atomic<size_t> foreign = 0;
+    time_readers(reader_count, 2,
+        [&first, &foreign](size_t) {
+            for (size_t i = 0; i < iterations; ++i) {
+                if (first.load() != 1) {
+                    foreign.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        },
+        [&first, &second](size_t writer, const std::atomic_bool& enabled) {
+            auto& target = writer == 0 ? first : second;
+            while (enabled) {
+                target.store(writer + 1);
+            }
+        });
+
+    std::cout << iterations << " loads per reader, " << foreign << " values of the other instance\n";
+}
+
+// reads per reader thread with the given number of readers and writers, returns elapsed time
+template <typename atomic_shared_ptr>
+std::chrono::nanoseconds time_workload(size_t reader_threads, size_t writer_threads, size_t reads) {
+    atomic_shared_ptr shared_ptr = std::make_shared<size_t>(0);
+
+    return time_readers(reader_threads, writer_threads,
+        [&shared_ptr, reads](size_t) {
+            size_t sum = 0;
+            for (size_t i = 0; i < reads; ++i) {
+                std::shared_ptr<size_t> local_ptr = shared_ptr;
+                sum += *local_ptr;
+            }
+            static_cast<void>(sum);
+        },
+        [&shared_ptr](size_t writer, const std::atomic_bool& enabled) {
+            auto local = std::make_shared<size_t>(writer + 1);
+            while (enabled) {
+                std::this_thread::sleep_for(writers_interval);
+                shared_ptr = local;
+            }
+        });
+}
+
+struct ring_tuning {
+    size_t ring_size = tuned_ring_size;
+    bool padded_usage = tuned_padded_ring_usage;
+    unsigned retry_backoff = tuned_ring_retry_backoff;
+    std::chrono::nanoseconds elapsed = std::chrono::nanoseconds::max();
+};
+
+const size_t tuning_reads = iterations / 4;
+const size_t tuning_repeats = 3;
+
+template <size_t ring_size, bool padded_usage, unsigned retry_backoff>
+void tune_ring_candidate(size_t reader_threads, size_t writer_threads, ring_tuning& best) {
+    using candidate = atomic_shared_ptr_with_ring<size_t, ring_size, false, padded_usage, retry_backoff>;
+    auto elapsed = std::chrono::nanoseconds::max();
+    for (size_t repeat = 0; repeat < tuning_repeats; ++repeat) {
+        elapsed = std::min(elapsed, time_workload<candidate>(reader_threads, writer_threads, tuning_reads));
+    }
+    std::cout << "ring_size " << ring_size << (padded_usage ? ", padded" : ", packed") <<
+        ", backoff " << retry_backoff << ": " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " us\n";
+    if (elapsed < best.elapsed) {
+        best = { ring_size, padded_usage, retry_backoff, elapsed };
+    }
+}
+
+template <size_t ring_size>
+void tune_ring_size(size_t reader_threads, size_t writer_threads, ring_tuning& best) {
+    tune_ring_candidate<ring_size, false, 0>(reader_threads, writer_threads, best);
+    tune_ring_candidate<ring_size, false, 16>(reader_threads, writer_threads, best);
+    tune_ring_candidate<ring_size, true, 0>(reader_threads, writer_threads, best);
+    tune_ring_candidate<ring_size, true, 16>(reader_threads, writer_threads, best);
+}
+
+// benchmarks ring configurations for the given workload and writes the fastest one as
+// the defaults header, which takes effect on the next build
+void tune(size_t reader_threads, size_t writer_threads, const std::string& path) {
+    std::cout << "tuning ring for " << reader_threads << " readers and " << writer_threads << " writers\n";
+    ring_tuning best;
+    tune_ring_size<2>(reader_threads, writer_threads, best);
+    tune_ring_size<4>(reader_threads, writer_threads, best);
+    tune_ring_size<8>(reader_threads, writer_threads, best);
+    tune_ring_size<16>(reader_threads, writer_threads, best);
+
+    std::ofstream config(path, std::ios::trunc);
+    config << "// generated by --tune " << reader_threads << " " << writer_threads <<
+        " on a machine with " << std::thread::hardware_concurrency() << " cpus\n";
+    config << "#pragma once\n\n";
+    config << "constexpr size_t tuned_ring_size = " << best.ring_size << ";\n";
+    config << "constexpr bool tuned_padded_ring_usage = " << (best.padded_usage ? "true" : "false") << ";\n";
+    config << "constexpr unsigned tuned_ring_retry_backoff = " << best.retry_backoff << ";\n";
+    if (!config.flush()) {
+        throw std::runtime_error("can't write " + path);
+    }
+    std::cout << "ring_size " << best.ring_size << (best.padded_usage ? ", padded" : ", packed") <<
+        ", backoff " << best.retry_backoff << " written to " << path << "\n";
+}
+
+// thread count argument of --tune, false unless it's a plain number in [min_count, max_tuned_threads]
+const size_t max_tuned_threads = 1024;
+
+bool parse_thread_count(const std::string& text, size_t min_count, size_t& count) {
+    if (text.empty() || text.size() > 4 || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    count = std::stoul(text);
+    return count >= min_count && count <= max_tuned_threads;
+}
+
+// the defaults header is included from the directory of this source file, not from the working one
+std::string default_config_path() {
+    std::string source = __FILE__;
+    auto separator = source.find_last_of("/\\");
+    return (separator == std::string::npos ? std::string() : source.substr(0, separator + 1)) + "AtomicSharedPtrConfig.h";
+}
+
+int main(int argc, char* argv[])
+{
+    for (int arg = 1; arg < argc; ++arg) {
+        if (std::string(argv[arg]) == "--pin-numa-nodes") {
+            pin_to_numa_nodes = true;
+            std::cout << "pinning threads to " << numa_node_count() << " numa nodes\n";
+        }
+    }
+#ifdef ATOMIC_SHARED_PTR_INJECT_FAULTS
+    for (int arg = 1; arg + 1 < argc; ++arg) {
+        if (std::string(argv[arg]) == "--fault-seed") {
+            fault_injection::seed = std::stoull(argv[arg + 1]);
+        }
+    }
+    std::cout << "injecting faults with seed " << fault_injection::seed << "\n";
+#endif
+    // --tune [readers writers [header]] only tunes the defaults for the given workload profile
+    for (int arg = 1; arg < argc; ++arg) {
+        if (std::string(argv[arg]) == "--tune") {
+            int values = 0;
+            while (arg + 1 + values < argc && std::string(argv[arg + 1 + values]).rfind("--", 0) != 0) {
+                ++values;
+            }
+            size_t readers = reader_count;
+            size_t writers = writer_count;
+            if (values == 1 || values > 3 || (values != 0 &&
+                (!parse_thread_count(argv[arg + 1], 1, readers) || !parse_thread_count(argv[arg + 2], 0, writers)))) {
+                std::cerr << "usage: --tune [readers writers [header]], with 1 to " << max_tuned_threads <<
+                    " readers and 0 to " << max_tuned_threads << " writers\n";
+                return 1;
+            }
+            std::string path = values == 3 ? argv[arg + 3] : default_config_path();
+            tune(readers, writers, path);
+            return 0;
+        }
+    }
+
+    std::cout << "regular shared_ptr impl\n";
+    run_test<std::shared_ptr>();
+    run_test<std::shared_ptr>();
+    run_test<std::shared_ptr>();
+
+    std::cout << "mutex impl\n";
+    run_test<naive_atomic_shared_ptr_with_mutex>();
+    run_test<naive_atomic_shared_ptr_with_mutex>();
+    run_test<naive_atomic_shared_ptr_with_mutex>();
+
+    std::cout << "mcs lock impl\n";
+    run_test<atomic_shared_ptr_with_mcs_lock>();
+    run_test<atomic_shared_ptr_with_mcs_lock>();
+    run_test<atomic_shared_ptr_with_mcs_lock>();
+
+    std::cout << "cohort lock impl\n";
+    run_test<atomic_shared_ptr_with_cohort_lock>();
+    run_test<atomic_shared_ptr_with_cohort_lock>();
+    run_test<atomic_shared_ptr_with_cohort_lock>();
+
+    std::cout << "hybrid futex lock impl\n";
+    run_test<atomic_shared_ptr_with_hybrid_lock>();
+    run_test<atomic_shared_ptr_with_hybrid_lock>();
+    run_test<atomic_shared_ptr_with_hybrid_lock>();
+
+    std::cout << "stamped lock impl\n";
+    run_test<atomic_shared_ptr_with_stamped_lock>();
+    run_test<atomic_shared_ptr_with_stamped_lock>();
+    run_test<atomic_shared_ptr_with_stamped_lock>();
+
+    std::cout << "std::atomic impl\n";
+    run_test<atomic_shared_ptr_using_std_atomic>();
     run_test<atomic_shared_ptr_using_std_atomic>();
     run_test<atomic_shared_ptr_using_std_atomic>();
 
@@ -197,5 +3734,213 @@ int main()
     run_test<atomic_shared_ptr_with_ring>();
     run_test<atomic_shared_ptr_with_ring>();
     run_test<atomic_shared_ptr_with_ring>();
+
+    std::cout << "interprocess impl\n";
+    run_test<interprocess_atomic_shared_ptr>();
+    run_test<interprocess_atomic_shared_ptr>();
+    run_test<interprocess_atomic_shared_ptr>();
+
+    std::cout << "deferred rc impl\n";
+    run_test<atomic_shared_ptr_with_deferred_rc>();
+    run_test<atomic_shared_ptr_with_deferred_rc>();
+    run_test<atomic_shared_ptr_with_deferred_rc>();
+
+    std::cout << "handle table impl\n";
+    run_handle_test();
+    run_handle_test();
+    run_handle_test();
+
+    std::cout << "type stable pool impl\n";
+    run_test<atomic_shared_ptr_with_type_stable_pool>();
+    run_test<atomic_shared_ptr_with_type_stable_pool>();
+    run_test<atomic_shared_ptr_with_type_stable_pool>();
+
+    std::cout << "type stable pool impl, optimistic load\n";
+    run_type_stable_pool_test();
+    run_type_stable_pool_test();
+    run_type_stable_pool_test();
+
+    std::cout << "delta chain impl\n";
+    run_test<delta_chain_atomic_shared_ptr>();
+    run_test<delta_chain_atomic_shared_ptr>();
+    run_test<delta_chain_atomic_shared_ptr>();
+
+    std::cout << "lazy impl\n";
+    run_test<lazy_atomic_shared_ptr>();
+    run_test<lazy_atomic_shared_ptr>();
+    run_test<lazy_atomic_shared_ptr>();
+
+    std::cout << "persistent impl, restart from snapshot\n";
+    run_persistent_test();
+    run_persistent_test();
+    run_persistent_test();
+
+    std::cout << "type stable pool impl, two instances sharing the pool\n";
+    check_type_stable_pool_instances();
+
+    std::cout << "read phase impl\n";
+    run_test<atomic_shared_ptr_with_read_phase>();
+    run_test<atomic_shared_ptr_with_read_phase>();
+    run_test<atomic_shared_ptr_with_read_phase>();
+
+    std::cout << "adaptive impl\n";
+    run_test<adaptive_atomic_shared_ptr>();
+    run_test<adaptive_atomic_shared_ptr>();
+    run_test<adaptive_atomic_shared_ptr>();
+
+    std::cout << "ring impl, no writers\n";
+    run_test<atomic_shared_ptr_with_ring, reader_count, 0>();
+    run_test<atomic_shared_ptr_with_ring, reader_count, 0>();
+    run_test<atomic_shared_ptr_with_ring, reader_count, 0>();
+
+    std::cout << "read phase impl, no writers\n";
+    run_test<atomic_shared_ptr_with_read_phase, reader_count, 0>();
+    run_test<atomic_shared_ptr_with_read_phase, reader_count, 0>();
+    run_test<atomic_shared_ptr_with_read_phase, reader_count, 0>();
+
+    std::cout << "adaptive impl, no writers\n";
+    run_test<adaptive_atomic_shared_ptr, reader_count, 0>();
+    run_test<adaptive_atomic_shared_ptr, reader_count, 0>();
+    run_test<adaptive_atomic_shared_ptr, reader_count, 0>();
+
+    std::cout << "ring impl, single writer\n";
+    run_test<atomic_shared_ptr_with_ring, reader_count, 1>();
+    run_test<atomic_shared_ptr_with_ring, reader_count, 1>();
+    run_test<atomic_shared_ptr_with_ring, reader_count, 1>();
+
+    std::cout << "single writer ring impl\n";
+    run_test<atomic_shared_ptr_with_single_writer_ring, reader_count, 1>();
+    run_test<atomic_shared_ptr_with_single_writer_ring, reader_count, 1>();
+    run_test<atomic_shared_ptr_with_single_writer_ring, reader_count, 1>();
+
+    std::cout << "ring impl, one reader and one writer\n";
+    run_test<atomic_shared_ptr_with_ring, 1, 1>();
+    run_test<atomic_shared_ptr_with_ring, 1, 1>();
+    run_test<atomic_shared_ptr_with_ring, 1, 1>();
+
+    std::cout << "spsc triple buffer impl, one reader and one writer\n";
+    run_test<spsc_triple_buffer, 1, 1>();
+    run_test<spsc_triple_buffer, 1, 1>();
+    run_test<spsc_triple_buffer, 1, 1>();
+
+    std::cout << "ring impl, publishing with 8 writers\n";
+    run_publish_test<atomic_shared_ptr_with_ring, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring, reader_count, 8>();
+
+    std::cout << "ring impl of size 16, publishing with 8 writers\n";
+    run_publish_test<atomic_shared_ptr_with_ring_16, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring_16, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring_16, reader_count, 8>();
+
+    std::cout << "ring impl of size 64, publishing with 8 writers\n";
+    run_publish_test<atomic_shared_ptr_with_ring_64, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring_64, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring_64, reader_count, 8>();
+
+    std::cout << "ring impl of size 256, publishing with 8 writers\n";
+    run_publish_test<atomic_shared_ptr_with_ring_256, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring_256, reader_count, 8>();
+    run_publish_test<atomic_shared_ptr_with_ring_256, reader_count, 8>();
+
+    std::cout << "ring impl, publishing fresh 1 MB values\n";
+    run_recycle_test<false, false>();
+    run_recycle_test<false, false>();
+    run_recycle_test<false, false>();
+
+    std::cout << "ring impl, publishing recycled 1 MB values\n";
+    run_recycle_test<true, false>();
+    run_recycle_test<true, false>();
+    run_recycle_test<true, false>();
+
+    std::cout << "ring impl, publishing fresh 1 MB values with eager release\n";
+    run_recycle_test<false, true>();
+    run_recycle_test<false, true>();
+    run_recycle_test<false, true>();
+
+    std::cout << "ring impl, loading 128 pointers one by one\n";
+    run_load_many_test<false>();
+    run_load_many_test<false>();
+    run_load_many_test<false>();
+
+    std::cout << "ring impl, loading 128 pointers with load_many\n";
+    run_load_many_test<true>();
+    run_load_many_test<true>();
+    run_load_many_test<true>();
+
+    std::cout << "ring impl, polling 4096 pointers for changes\n";
+    run_change_watch_test<false>();
+    run_change_watch_test<false>();
+    run_change_watch_test<false>();
+
+    std::cout << "ring impl, scanning change index of 4096 pointers\n";
+    run_change_watch_test<true>();
+    run_change_watch_test<true>();
+    run_change_watch_test<true>();
+
+    std::cout << "ring impl, sweeping 4096 pointers while they are published\n";
+    check_change_index_sweep();
+    check_change_index_sweep();
+    check_change_index_sweep();
+
+    std::cout << "ring impl, updating single keys of a 4096 entry table\n";
+    run_delta_test<false>();
+    run_delta_test<false>();
+    run_delta_test<false>();
+
+    std::cout << "delta chain impl, updating single keys of a 4096 entry table\n";
+    run_delta_test<true>();
+    run_delta_test<true>();
+    run_delta_test<true>();
+
+    std::cout << "lazy impl, publishing 4096 entry tables eagerly\n";
+    run_lazy_test<false>();
+    run_lazy_test<false>();
+    run_lazy_test<false>();
+
+    std::cout << "lazy impl, publishing 4096 entry tables lazily\n";
+    run_lazy_test<true>();
+    run_lazy_test<true>();
+    run_lazy_test<true>();
+
+    std::cout << "lazy impl, publishing 4096 entry tables eagerly, reads sparser than publishes\n";
+    run_lazy_test<false, true>();
+    run_lazy_test<false, true>();
+    run_lazy_test<false, true>();
+
+    std::cout << "lazy impl, publishing 4096 entry tables lazily, reads sparser than publishes\n";
+    run_lazy_test<true, true>();
+    run_lazy_test<true, true>();
+    run_lazy_test<true, true>();
+
+    std::cout << "mutex impl, thread churn\n";
+    run_churn_test<naive_atomic_shared_ptr_with_mutex>();
+    run_churn_test<naive_atomic_shared_ptr_with_mutex>();
+    run_churn_test<naive_atomic_shared_ptr_with_mutex>();
+
+    std::cout << "std::atomic impl, thread churn\n";
+    run_churn_test<atomic_shared_ptr_using_std_atomic>();
+    run_churn_test<atomic_shared_ptr_using_std_atomic>();
+    run_churn_test<atomic_shared_ptr_using_std_atomic>();
+
+    std::cout << "ring impl, thread churn\n";
+    run_churn_test<atomic_shared_ptr_with_ring>();
+    run_churn_test<atomic_shared_ptr_with_ring>();
+    run_churn_test<atomic_shared_ptr_with_ring>();
+
+    std::cout << "deferred rc impl, thread churn\n";
+    run_churn_test<atomic_shared_ptr_with_deferred_rc>();
+    run_churn_test<atomic_shared_ptr_with_deferred_rc>();
+    run_churn_test<atomic_shared_ptr_with_deferred_rc>();
+
+    std::cout << "read phase impl, thread churn\n";
+    run_churn_test<atomic_shared_ptr_with_read_phase>();
+    run_churn_test<atomic_shared_ptr_with_read_phase>();
+    run_churn_test<atomic_shared_ptr_with_read_phase>();
+
+    std::cout << "adaptive impl, thread churn\n";
+    run_churn_test<adaptive_atomic_shared_ptr>();
+    run_churn_test<adaptive_atomic_shared_ptr>();
+    run_churn_test<adaptive_atomic_shared_ptr>();
 }
 